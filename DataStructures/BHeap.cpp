@@ -1,11 +1,12 @@
 /*
  * Implementation of a Binomial Heap.
  * 
- * This file contains two classes:
+ * This file contains three classes:
  * 1. BHeap
  * 2. BNode
+ * 3. BHandle
  * 
- * Both of these classes are templated, with
+ * All of these classes are templated, with
  * two typenames: keytype and valuetype.
  * Therefore, any instantiation of BNode or
  * BHeap must be as follows:
@@ -14,6 +15,53 @@
  * 2. template <typename keytype, typename valuetype>
  *    BHeap<keytype, valuetype> that_name;
  * 
+ * Every BHeap draws its BNodes from its own SlabPool, so
+ * inserts and extractions reuse freed nodes instead of calling
+ * new and delete, and destroying a BHeap of trivially
+ * destructible keys and values frees its slabs without walking
+ * the trees. merge takes over the other heap's slabs along with
+ * its nodes, one step per slab of the other heap (O(log n) of them
+ * while slabs still double). Stats() reports the pool's
+ * allocation counters.
+ * 
+ * A BHeap is either EAGER (the default) or LAZY, chosen when it
+ * is constructed:
+ *    BHeap<keytype, valuetype> lazy_heap(LAZY);
+ * An EAGER heap keeps at most one tree of each degree at all
+ * times, so insert and merge link trees right away. A LAZY heap
+ * (as in a Fibonacci heap) only splices root lists in insert and
+ * merge, which is O(1) apart from taking over the slabs, and
+ * links trees of equal degree inside extractMin, whose amortized
+ * cost stays O(log n). Both keep a pointer to the minimum root, so
+ * peekKey and peekValue are O(1).
+ * Merging a LAZY heap into an EAGER one consolidates it first.
+ * Peeking at or extracting from an empty BHeap throws
+ * std::out_of_range.
+ * 
+ * insert returns a BHandle for the new element, which
+ * decreaseKey and erase take. Both move an element up its tree
+ * by swapping payloads (key, value and handle) with its parent,
+ * so a handle keeps finding its element however it moves, and
+ * both are O(log n) (amortized, for a LAZY heap). A handle
+ * belongs to the heap that inserted the element (merge carries
+ * it along, copies do not) and must not be used once the element
+ * has been extracted or erased.
+ * 
+ * The array constructor and insertMany build their trees like a
+ * binary counter: each new node is a tree of degree 0 that links
+ * with the tree of equal degree built so far, as a carry would,
+ * so s elements take s - popcount(s) links and O(s) time in all,
+ * with no intermediate root list merges. The result is then
+ * merged into the heap in one step. insertMany moves the keys and
+ * values out of the caller's spans and requires C++20 (for
+ * std::span). Elements added by the constructor have no handles.
+ * 
+ * Copying, destroying and printing a BHeap walk its trees with
+ * an explicit stack (a CDA) rather than recursion, so the call
+ * stack stays shallow however long the sibling chains get. A copy
+ * is one pass that links each new node to its parent as it is
+ * made, out of a single slab reserved for the whole heap.
+ * 
  * 
  * @author      Stephen Gregory
  * @date        04/21/2020
@@ -22,6 +70,21 @@
 #ifndef BHEAP_CPP
 #define BHEAP_CPP
 
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "CDA.cpp"
+#include "SlabPool.cpp"
+
+
+// BHeapMode decides when a BHeap links trees of equal degree.
+enum BHeapMode {EAGER = 0, LAZY = 1};
+
+
+template <typename keytype, typename valuetype>
+struct BHandle;
+
 
 // BNode is one element of a binomial tree inside of
 // a binomial bheap (BHeap). A BNode can also be considered 
@@ -35,6 +98,7 @@ struct BNode {
     BNode* parent; 
     BNode* sibling;
     BNode* child; 
+    BHandle<keytype, valuetype>* handle;                // The handle of the element held here, nullptr if it has none
     bool operator<(BNode const &rhs) { return key < rhs.key; };
     bool operator<=(BNode const &rhs) { return key <= rhs.key; };
     bool operator==(BNode const &rhs) { return key == rhs.key; };
@@ -43,13 +107,20 @@ struct BNode {
 };
 
 
+// BHandle follows one element of a BHeap from BNode to BNode.
+template <typename keytype, typename valuetype>
+struct BHandle {
+    BNode<keytype, valuetype>* node;                    // The BNode currently holding the element
+};
+
+
 // BHeap is a Binomial Min-Ordered Heap
 template <typename keytype, typename valuetype>
 class BHeap {
 public:
 
-    BHeap();                                                                        // Default Constructor for empty Heap.
-    BHeap(keytype k[], valuetype v[], int s);                                       // Constructor using array of keys(k[]) and values([v]) with size s.
+    BHeap(BHeapMode mode = EAGER);                                                  // Default Constructor for empty Heap.
+    BHeap(keytype k[], valuetype v[], int s, BHeapMode mode = EAGER);               // Constructor using array of keys(k[]) and values([v]) with size s.
     BHeap(const BHeap &other);                                                      // Copy Constructor.
     BHeap& operator=(const BHeap& other);                                           // Copy Assignment Operator.
     BNode<keytype, valuetype>* copyHelper(BNode<keytype, valuetype>* to_copy);      // Helper function for copying a BHeap.
@@ -59,13 +130,19 @@ public:
     valuetype peekValue();                                                          // Return min value without modifying the Heap.
     keytype extractMin();                                                           // Removes the min key in the Heap and returns the key.
     BNode<keytype, valuetype>* reverseChildren(BNode<keytype, valuetype>* child_ptr);   // Reverses the order of children, given the leftmost child.
-    void insert(keytype k, valuetype v);                                            // Inserts a node with key k and value v into the heap.
+    BHandle<keytype, valuetype>* insert(keytype k, valuetype v);                    // Inserts a node with key k and value v into the heap, returns its handle.
+    void decreaseKey(BHandle<keytype, valuetype>* handle, keytype k);               // Lower the key of the element with the given handle to k.
+    void erase(BHandle<keytype, valuetype>* handle);                                // Remove the element with the given handle.
+    void insertMany(std::span<keytype> keys, std::span<valuetype> values, std::span<BHandle<keytype, valuetype>*> handles = {});
+                                                                                    // Moves keys[i] and values[i] into the heap, handles[i] gets each handle.
     void merge(BHeap<keytype, valuetype> &bheap2);                                  // Merges the Heap H2 into the current heap.
     void mergeEqualDegree();                                                        // Merge all trees of equal degree.
     void printKey();                                                                // Prints the keys in the heap.
     void printBinomialTree(BNode<keytype, valuetype>* root);                        // Prints the keys of one specific binomial tree.
     void setHead(BNode<keytype, valuetype>* head);                                  // Setter for the head.
     BNode<keytype, valuetype>* getHead();                                           // Getter for the head.
+    SlabPoolStats Stats();                                                          // Allocation counters of this heap's node pool.
+    BHeapMode getMode();                                                            // Whether this heap is EAGER or LAZY.
 
     ~BHeap();                                                                       // Destructor.
     void destroy(BNode<keytype, valuetype>* bnode);                                 // Helper function for destructor.
@@ -74,6 +151,24 @@ public:
 private:
 
     BNode<keytype, valuetype>* head;                                                // Pointer to leftmost Binomial Tree root.
+    BNode<keytype, valuetype>* min_;                                                // The root with the smallest key, nullptr when empty.
+    BNode<keytype, valuetype>* tail_;                                               // The rightmost root, nullptr when empty.
+    BHeapMode mode_;
+    SlabPool<BNode<keytype, valuetype>> pool_;                                      // Every BNode of this heap lives in pool_.
+    SlabPool<BHandle<keytype, valuetype>> handle_pool_;                             // And every BHandle in handle_pool_.
+    BNode<keytype, valuetype>* bubbleUp(BNode<keytype, valuetype>* bnode, bool to_root);
+                                                                                    // Swap bnode's payload up while it beats its parent (or to the root).
+    keytype removeRoot(BNode<keytype, valuetype>* root);                            // Remove a root, making its children roots, returns its key.
+    void releaseBNode(BNode<keytype, valuetype>* bnode);                            // Return bnode and its handle to the pools.
+    void clear();                                                                   // Destroy every node and free both pools.
+    template <bool Move>
+    void insertBatch(keytype k[], valuetype v[], int s, BHandle<keytype, valuetype>* handles[]);
+                                                                                    // Build trees of s elements binary counter style and merge them in.
+    void mergeRootList(BNode<keytype, valuetype>* other_head);                      // Merge a root list (in this heap's pool) into this heap.
+    void spliceRootList(BNode<keytype, valuetype>* other_head, BNode<keytype, valuetype>* other_tail, BNode<keytype, valuetype>* other_min);
+                                                                                    // Append a root list without linking any trees (LAZY).
+    void consolidate();                                                             // Link roots of equal degree, leaving them sorted by degree.
+    void updateRoots();                                                             // Find min_ and tail_ by walking the root list.
     void initializeBNode(BNode<keytype, valuetype>* bnode, keytype key, valuetype value, int degree=0);
                                                                                     // Initializes bnode with default values,
                                                                                     // all pointers point to nullptr.
@@ -84,31 +179,34 @@ private:
 
 
 template <typename keytype, typename valuetype>
-BHeap<keytype, valuetype>::BHeap() {
+BHeap<keytype, valuetype>::BHeap(BHeapMode mode) {
     head = nullptr;
+    min_ = nullptr;
+    tail_ = nullptr;
+    mode_ = mode;
 }
 
 
 template <typename keytype, typename valuetype>
-BHeap<keytype, valuetype>::BHeap(keytype k[], valuetype v[], int s) {
+BHeap<keytype, valuetype>::BHeap(keytype k[], valuetype v[], int s, BHeapMode mode) {
     head = nullptr;
-    for (int i = 0; i < s; i++) {
-        insert(k[i], v[i]);
-    }
+    min_ = nullptr;
+    tail_ = nullptr;
+    mode_ = mode;
+    insertBatch<false>(k, v, s, nullptr);
 }
 
 
 // Copy Assignment Operator
 template <typename keytype, typename valuetype>
 BHeap<keytype, valuetype>& BHeap<keytype, valuetype>::operator=(const BHeap<keytype, valuetype>& other) {
-    if (head == head) {
+    if (this == &other) {
         return *this;
     }
-    delete head;
-    head = nullptr;
-    BHeap<keytype, valuetype> temp(other);
-    head = temp.head;
-    temp.head = nullptr;
+    clear();
+    mode_ = other.mode_;
+    head = copyHelper(other.head);
+    updateRoots();
     return *this;
 }
 
@@ -116,9 +214,12 @@ BHeap<keytype, valuetype>& BHeap<keytype, valuetype>::operator=(const BHeap<keyt
 // Copy Constructor
 template <typename keytype, typename valuetype>
 BHeap<keytype,valuetype>::BHeap(const BHeap<keytype, valuetype> &bheap) {
+    head = nullptr;
+    min_ = nullptr;
+    tail_ = nullptr;
+    mode_ = bheap.mode_;
     head = copyHelper(bheap.head);
-    BNode<keytype, valuetype>* curr = head;
-    copyHelperParentAssigner(curr);
+    updateRoots();
 }
 
 
@@ -127,14 +228,49 @@ BNode<keytype, valuetype>* BHeap<keytype,valuetype>::copyHelper(BNode<keytype, v
     if (to_copy == nullptr) {
         return nullptr;
     }
-    BNode<keytype, valuetype>* copy_node = new BNode<keytype, valuetype>;
-    copy_node->key = to_copy->key;
-    copy_node->value = to_copy->value;
-    copy_node->degree = to_copy->degree;
-    copy_node->parent = nullptr;
-    copy_node->child = copyHelper(to_copy->child);
-    copy_node->sibling = copyHelper(to_copy->sibling);
-    return copy_node;
+
+    // A tree of degree d holds 2^d nodes, so the whole copy fits in one slab.
+    long long node_count = 0;
+    for (BNode<keytype, valuetype>* root = to_copy; root != nullptr; root = root->sibling) {
+        node_count += 1LL << root->degree;
+    }
+    pool_.reserve(node_count);
+
+    // Each entry is a sibling chain still to be copied and the copy of its
+    // parent, so parents are known (and set) as every node is copied.
+    BNode<keytype, valuetype>* copy_head = nullptr;
+    CDA<BNode<keytype, valuetype>*, UncheckedIndex> chains;
+    CDA<BNode<keytype, valuetype>*, UncheckedIndex> parents;
+    chains.AddEnd(to_copy);
+    parents.AddEnd(nullptr);
+    while (chains.Length() > 0) {
+        BNode<keytype, valuetype>* source = chains[chains.Length() - 1];
+        BNode<keytype, valuetype>* parent = parents[parents.Length() - 1];
+        chains.DelEnd();
+        parents.DelEnd();
+
+        BNode<keytype, valuetype>* prev = nullptr;
+        for (; source != nullptr; source = source->sibling) {
+            BNode<keytype, valuetype>* copy_node = pool_.allocate();
+            initializeBNode(copy_node, source->key, source->value, source->degree);
+            copy_node->parent = parent;
+            if (prev != nullptr) {
+                prev->sibling = copy_node;
+            }
+            else if (parent != nullptr) {
+                parent->child = copy_node;
+            }
+            else {
+                copy_head = copy_node;
+            }
+            if (source->child != nullptr) {
+                chains.AddEnd(source->child);
+                parents.AddEnd(copy_node);
+            }
+            prev = copy_node;
+        }
+    }
+    return copy_head;
 }
 
 
@@ -143,24 +279,34 @@ void BHeap<keytype,valuetype>::copyHelperParentAssigner(BNode<keytype, valuetype
     if (bnode == nullptr) {
         return;
     }
-    BNode<keytype, valuetype>* child_ptr = bnode->child;
-    while(child_ptr != nullptr) {
-        child_ptr->parent = bnode;
-        child_ptr = child_ptr->sibling;
+    CDA<BNode<keytype, valuetype>*, UncheckedIndex> chains;
+    chains.AddEnd(bnode);
+    while (chains.Length() > 0) {
+        BNode<keytype, valuetype>* curr = chains[chains.Length() - 1];
+        chains.DelEnd();
+        for (; curr != nullptr; curr = curr->sibling) {
+            BNode<keytype, valuetype>* child_ptr = curr->child;
+            if (child_ptr != nullptr) {
+                chains.AddEnd(child_ptr);
+            }
+            while (child_ptr != nullptr) {
+                child_ptr->parent = curr;
+                child_ptr = child_ptr->sibling;
+            }
+        }
     }
-    copyHelperParentAssigner(bnode->sibling);
-    copyHelperParentAssigner(bnode->child);
 }
 
 
 template <typename keytype, typename valuetype>
 void BHeap<keytype, valuetype>::initializeBNode(BNode<keytype, valuetype>* bnode, keytype key, valuetype value, int degree) {
-    bnode->key = key;
-    bnode->value = value;
+    bnode->key = std::move(key);
+    bnode->value = std::move(value);
     bnode->degree = degree;
     bnode->parent = nullptr;
     bnode->child = nullptr;
     bnode->sibling = nullptr;
+    bnode->handle = nullptr;
 }
 
 
@@ -178,73 +324,167 @@ void BHeap<keytype, valuetype>::linkBinomialTrees(BNode<keytype, valuetype>* x,
 
 template <typename keytype, typename valuetype>
 keytype BHeap<keytype,valuetype>::peekKey() {
-    BNode<keytype, valuetype>* curr = head;
-    BNode<keytype, valuetype>* prev_min = nullptr;
-    // Find the root with minimum key
-    BNode<keytype, valuetype>* min_ptr = nullptr;
-    BNode<keytype, valuetype>* prev_ptr = nullptr;
-    keytype min;
-    if (curr != nullptr) {
-        min = curr->key;
-    }
-    while (curr != nullptr) {
-        if (curr->key <= min) {
-            min = curr->key;
-            prev_min = prev_ptr;
-            min_ptr = curr;
-        }
-        prev_ptr = curr;
-        curr = curr->sibling;
+    if (min_ == nullptr) {
+        throw std::out_of_range("BHeap::peekKey on an empty heap");
     }
-    return min_ptr->key;
+    return min_->key;
 }
 
 
 template <typename keytype, typename valuetype>
 valuetype BHeap<keytype,valuetype>::peekValue() {
-    BNode<keytype, valuetype>* curr = head;
-    BNode<keytype, valuetype>* prev_min = nullptr;
-    // Find the root with minimum key
-    BNode<keytype, valuetype>* min_ptr = nullptr;
-    BNode<keytype, valuetype>* prev_ptr = nullptr;
-    keytype min;
-    if (curr != nullptr) {
-        min = curr->key;
+    if (min_ == nullptr) {
+        throw std::out_of_range("BHeap::peekValue on an empty heap");
     }
-    while (curr != nullptr) {
-        if (curr->key <= min) {
-            min = curr->key;
-            prev_min = prev_ptr;
-            min_ptr = curr;
-        }
-        prev_ptr = curr;
-        curr = curr->sibling;
+    return min_->value;
+}
+
+
+template <typename keytype, typename valuetype>
+BHandle<keytype, valuetype>* BHeap<keytype, valuetype>::insert(keytype key, valuetype value) {
+    BNode<keytype, valuetype>* new_bnode = pool_.allocate();
+    initializeBNode(new_bnode, key, value, 0);
+    BHandle<keytype, valuetype>* handle = handle_pool_.allocate();
+    handle->node = new_bnode;
+    new_bnode->handle = handle;
+    if (mode_ == LAZY) {
+        spliceRootList(new_bnode, new_bnode, new_bnode);
+        return handle;
     }
-    return min_ptr->value;
+    mergeRootList(new_bnode);
+    updateRoots();
+    return handle;
 }
 
 
 template <typename keytype, typename valuetype>
-void BHeap<keytype, valuetype>::insert(keytype key, valuetype value) {
-    if (head == nullptr) {
-        BNode<keytype, valuetype>* first_node = new BNode<keytype, valuetype>;
-        initializeBNode(first_node, key, value, 0);
-        head = first_node;
+void BHeap<keytype, valuetype>::decreaseKey(BHandle<keytype, valuetype>* handle, keytype k) {
+    BNode<keytype, valuetype>* bnode = handle->node;
+    if (bnode->key < k) {
+        throw std::invalid_argument("BHeap::decreaseKey new key is larger than the current key");
+    }
+    bnode->key = k;
+    bnode = bubbleUp(bnode, false);
+    if (bnode->parent == nullptr && bnode->key < min_->key) {
+        min_ = bnode;
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+void BHeap<keytype, valuetype>::erase(BHandle<keytype, valuetype>* handle) {
+    // Carry the element up to the root of its tree, then remove that root.
+    removeRoot(bubbleUp(handle->node, true));
+}
+
+
+template <typename keytype, typename valuetype>
+void BHeap<keytype, valuetype>::insertMany(std::span<keytype> keys, std::span<valuetype> values, std::span<BHandle<keytype, valuetype>*> handles) {
+    if (keys.size() != values.size()) {
+        throw std::invalid_argument("BHeap::insertMany needs one value per key");
+    }
+    if (!handles.empty() && handles.size() < keys.size()) {
+        throw std::invalid_argument("BHeap::insertMany needs one handle per key");
+    }
+    insertBatch<true>(keys.data(), values.data(), (int)keys.size(), handles.empty() ? nullptr : handles.data());
+}
+
+
+template <typename keytype, typename valuetype>
+template <bool Move>
+void BHeap<keytype, valuetype>::insertBatch(keytype k[], valuetype v[], int s, BHandle<keytype, valuetype>* handles[]) {
+    if (s <= 0) {
         return;
     }
+    pool_.reserve(s);
+    if (handles != nullptr) {
+        handle_pool_.reserve(s);
+    }
 
-    BHeap<keytype, valuetype> new_bheap;
-    BNode<keytype, valuetype>* new_bnode = new BNode<keytype, valuetype>;
-    initializeBNode(new_bnode, key, value, 0);
-    new_bheap.setHead(new_bnode);
-    merge(new_bheap);
-    new_bheap.head = nullptr;
+    // carry[d] is the tree of degree d built so far, like bit d of a
+    // binary counter. Adding a node links equal degree trees as carries.
+    BNode<keytype, valuetype>* carry[64] = {};
+    for (int i = 0; i < s; i++) {
+        BNode<keytype, valuetype>* tree = pool_.allocate();
+        if constexpr (Move) {
+            initializeBNode(tree, std::move(k[i]), std::move(v[i]), 0);
+        }
+        else {
+            initializeBNode(tree, k[i], v[i], 0);
+        }
+        if (handles != nullptr) {
+            handles[i] = handle_pool_.allocate();
+            handles[i]->node = tree;
+            tree->handle = handles[i];
+        }
+
+        int degree = 0;
+        while (carry[degree] != nullptr) {
+            BNode<keytype, valuetype>* other = carry[degree];
+            carry[degree] = nullptr;
+            if (other->key < tree->key) {
+                std::swap(tree, other);
+            }
+            linkBinomialTrees(tree, other);
+            degree++;
+        }
+        carry[degree] = tree;
+    }
+
+    // The carries, in order of degree, are a root list of their own.
+    BNode<keytype, valuetype>* list_head = nullptr;
+    BNode<keytype, valuetype>* list_tail = nullptr;
+    BNode<keytype, valuetype>* list_min = nullptr;
+    for (int degree = 0; degree < 64; degree++) {
+        BNode<keytype, valuetype>* root = carry[degree];
+        if (root == nullptr) {
+            continue;
+        }
+        if (list_head == nullptr) {
+            list_head = root;
+        }
+        else {
+            list_tail->sibling = root;
+        }
+        list_tail = root;
+        if (list_min == nullptr || root->key < list_min->key) {
+            list_min = root;
+        }
+    }
+
+    if (mode_ == LAZY || head == nullptr) {
+        spliceRootList(list_head, list_tail, list_min);
+    }
+    else {
+        mergeRootList(list_head);
+        updateRoots();
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+BNode<keytype, valuetype>* BHeap<keytype, valuetype>::bubbleUp(BNode<keytype, valuetype>* bnode, bool to_root) {
+    while (bnode->parent != nullptr && (to_root || bnode->key < bnode->parent->key)) {
+        BNode<keytype, valuetype>* parent = bnode->parent;
+        std::swap(bnode->key, parent->key);
+        std::swap(bnode->value, parent->value);
+        std::swap(bnode->handle, parent->handle);
+        if (bnode->handle != nullptr) {
+            bnode->handle->node = bnode;
+        }
+        if (parent->handle != nullptr) {
+            parent->handle->node = parent;
+        }
+        bnode = parent;
+    }
+    return bnode;
 }
 
 
 template <typename keytype, typename valuetype>
 void BHeap<keytype, valuetype>::setHead(BNode<keytype, valuetype>* head) {
     this->head = head;
+    updateRoots();
 }
 
 
@@ -254,16 +494,55 @@ BNode<keytype, valuetype>* BHeap<keytype, valuetype>::getHead() {
 }
 
 
+template <typename keytype, typename valuetype>
+SlabPoolStats BHeap<keytype, valuetype>::Stats() {
+    return pool_.Stats();
+}
+
+
+template <typename keytype, typename valuetype>
+BHeapMode BHeap<keytype, valuetype>::getMode() {
+    return mode_;
+}
+
+
 template <typename keytype, typename valuetype>
 void BHeap<keytype, valuetype>::merge(BHeap<keytype, valuetype> &bheap2) {
+    if (&bheap2 == this) {
+        return;
+    }
+    // bheap2's nodes become ours, and so does the memory they live in.
+    pool_.adopt(bheap2.pool_);
+    handle_pool_.adopt(bheap2.handle_pool_);
+    if (mode_ == LAZY) {
+        spliceRootList(bheap2.head, bheap2.tail_, bheap2.min_);
+    }
+    else {
+        // mergeRootList needs a root list sorted by degree.
+        if (bheap2.mode_ == LAZY) {
+            bheap2.consolidate();
+        }
+        mergeRootList(bheap2.head);
+        updateRoots();
+    }
+    bheap2.head = nullptr;
+    bheap2.min_ = nullptr;
+    bheap2.tail_ = nullptr;
+}
+
+
+template <typename keytype, typename valuetype>
+void BHeap<keytype, valuetype>::mergeRootList(BNode<keytype, valuetype>* other_head) {
     BNode<keytype, valuetype>* curr1 = getHead();
-    BNode<keytype, valuetype>* curr2 = bheap2.getHead();
+    BNode<keytype, valuetype>* curr2 = other_head;
     BNode<keytype, valuetype>* curr3 = nullptr;
     BNode<keytype, valuetype>* temp = nullptr;
 
     if (curr1 == nullptr) {
-        setHead(curr2);
-        bheap2.head = nullptr;
+        head = curr2;
+        return;
+    }
+    if (curr2 == nullptr) {
         return;
     }
 
@@ -315,9 +594,90 @@ void BHeap<keytype, valuetype>::merge(BHeap<keytype, valuetype> &bheap2) {
     // Go through the merged list of roots and merge all 
     // trees of equal degree.
 
-    setHead(temp);
+    head = temp;
     mergeEqualDegree();
-    bheap2.head = nullptr;
+}
+
+
+template <typename keytype, typename valuetype>
+void BHeap<keytype, valuetype>::spliceRootList(BNode<keytype, valuetype>* other_head, BNode<keytype, valuetype>* other_tail, BNode<keytype, valuetype>* other_min) {
+    if (other_head == nullptr) {
+        return;
+    }
+    if (head == nullptr) {
+        head = other_head;
+    }
+    else {
+        tail_->sibling = other_head;
+    }
+    tail_ = other_tail;
+    if (min_ == nullptr || other_min->key < min_->key) {
+        min_ = other_min;
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+void BHeap<keytype, valuetype>::consolidate() {
+    // A tree of degree d has 2^d nodes, so 64 degrees are plenty.
+    BNode<keytype, valuetype>* by_degree[64] = {};
+    int max_degree = -1;
+    BNode<keytype, valuetype>* curr = head;
+    while (curr != nullptr) {
+        BNode<keytype, valuetype>* next = curr->sibling;
+        curr->sibling = nullptr;
+        while (by_degree[curr->degree] != nullptr) {
+            BNode<keytype, valuetype>* other = by_degree[curr->degree];
+            by_degree[curr->degree] = nullptr;
+            if (other->key < curr->key) {
+                BNode<keytype, valuetype>* swap_temp = curr;
+                curr = other;
+                other = swap_temp;
+            }
+            linkBinomialTrees(curr, other);
+        }
+        by_degree[curr->degree] = curr;
+        if (curr->degree > max_degree) {
+            max_degree = curr->degree;
+        }
+        curr = next;
+    }
+
+    // Rebuild the root list in order of degree, which EAGER heaps rely on.
+    head = nullptr;
+    tail_ = nullptr;
+    min_ = nullptr;
+    for (int degree = 0; degree <= max_degree; degree++) {
+        BNode<keytype, valuetype>* root = by_degree[degree];
+        if (root == nullptr) {
+            continue;
+        }
+        if (head == nullptr) {
+            head = root;
+        }
+        else {
+            tail_->sibling = root;
+        }
+        tail_ = root;
+        if (min_ == nullptr || root->key < min_->key) {
+            min_ = root;
+        }
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+void BHeap<keytype, valuetype>::updateRoots() {
+    min_ = head;
+    tail_ = head;
+    BNode<keytype, valuetype>* curr = head;
+    while (curr != nullptr) {
+        if (curr->key < min_->key) {
+            min_ = curr;
+        }
+        tail_ = curr;
+        curr = curr->sibling;
+    }
 }
 
 template <typename keytype, typename valuetype>
@@ -357,61 +717,72 @@ void BHeap<keytype,valuetype>::mergeEqualDegree() {
 
 template <typename keytype, typename valuetype>
 keytype BHeap<keytype, valuetype>::extractMin() {
-    BNode<keytype, valuetype>* curr = head;
-    BNode<keytype, valuetype>* prev_min = nullptr;
-    // Find the root with minimum key
-    BNode<keytype, valuetype>* min_ptr = nullptr;
-    BNode<keytype, valuetype>* prev_ptr = nullptr;
-    keytype min = curr->key;
-
-    while (curr != nullptr) {
-        if (curr->key <= min) {
-            min = curr->key;
-            prev_min = prev_ptr;
-            min_ptr = curr;
-        }
-        prev_ptr = curr;
-        curr = curr->sibling;
+    if (head == nullptr) {
+        throw std::out_of_range("BHeap::extractMin on an empty heap");
     }
+    return removeRoot(min_);
+}
 
-    // Delete the node pointed to by min_ptr
-    if (prev_min != nullptr && min_ptr->sibling != nullptr) {
-        prev_min->sibling = min_ptr->sibling;
-    }
-    else if (prev_min != nullptr && min_ptr->sibling == nullptr) {
-        prev_min->sibling = nullptr;
+
+template <typename keytype, typename valuetype>
+keytype BHeap<keytype, valuetype>::removeRoot(BNode<keytype, valuetype>* root) {
+    // Unlink root from the root list.
+    BNode<keytype, valuetype>* prev_ptr = nullptr;
+    if (head != root) {
+        prev_ptr = head;
+        while (prev_ptr->sibling != root) {
+            prev_ptr = prev_ptr->sibling;
+        }
+        prev_ptr->sibling = root->sibling;
     }
     else {
-        setHead(min_ptr->sibling);
+        head = root->sibling;
     }
-
-    // If there are no children, just delete the node and return the min key
-    if (min_ptr->child == nullptr) {
-        delete min_ptr;
-        min_ptr = nullptr;
-        return min;
+    if (tail_ == root) {
+        tail_ = prev_ptr;
     }
 
     // Remove the parent reference from all of the children
-    BNode<keytype, valuetype>* child_ptr = min_ptr->child;
-    while (child_ptr != nullptr) {
+    BNode<keytype, valuetype>* child_tail = nullptr;
+    for (BNode<keytype, valuetype>* child_ptr = root->child; child_ptr != nullptr; child_ptr = child_ptr->sibling) {
         child_ptr->parent = nullptr;
-        child_ptr = child_ptr->sibling;
+        child_tail = child_ptr;
+    }
+    keytype root_key = root->key;
+
+    if (mode_ == LAZY) {
+        // The children become roots, in any order, then all roots are linked up.
+        if (child_tail != nullptr) {
+            if (head == nullptr) {
+                head = root->child;
+            }
+            else {
+                tail_->sibling = root->child;
+            }
+            tail_ = child_tail;
+        }
+        releaseBNode(root);
+        consolidate();
+        return root_key;
     }
 
-    // Reverse the order of the children
-    BNode<keytype, valuetype>* child_list_head = reverseChildren(min_ptr->child);
+    // Children are kept in decreasing degree, reversed they form a root list
+    // that can be merged with the rest.
+    if (root->child != nullptr) {
+        mergeRootList(reverseChildren(root->child));
+    }
+    releaseBNode(root);
+    updateRoots();
+    return root_key;
+}
 
-    // Create a new child_heap with the child subtrees
-    BHeap<keytype, valuetype> child_heap;
-    child_heap.setHead(child_list_head);
 
-    // Merge the children heap and the original heap
-    merge(child_heap);
-    // child_heap.head = nullptr;
-    delete min_ptr;
-    min_ptr = nullptr;
-    return min;
+template <typename keytype, typename valuetype>
+void BHeap<keytype, valuetype>::releaseBNode(BNode<keytype, valuetype>* bnode) {
+    if (bnode->handle != nullptr) {
+        handle_pool_.release(bnode->handle);
+    }
+    pool_.release(bnode);
 }
 
 
@@ -456,33 +827,66 @@ void BHeap<keytype, valuetype>::printBinomialTree(BNode<keytype, valuetype>* roo
     if (root == nullptr) {
         return;
     }
-    std::cout << root->key << " ";
-    // First, print the subtree at the leftmost child
-    printBinomialTree(root->child);
-    // Then, print the subtree at the next sibling
-    printBinomialTree(root->sibling);
+    // Print each node, then the subtree at its leftmost child, then the one
+    // at its next sibling. The sibling is pushed first so it comes out last.
+    CDA<BNode<keytype, valuetype>*, UncheckedIndex> pending;
+    pending.AddEnd(root);
+    while (pending.Length() > 0) {
+        BNode<keytype, valuetype>* curr = pending[pending.Length() - 1];
+        pending.DelEnd();
+        std::cout << curr->key << " ";
+        if (curr->sibling != nullptr) {
+            pending.AddEnd(curr->sibling);
+        }
+        if (curr->child != nullptr) {
+            pending.AddEnd(curr->child);
+        }
+    }
 }
 
 
 template <typename keytype, typename valuetype>
 BHeap<keytype, valuetype>::~BHeap() {
-    // cout << "~~~In Destructor~~~\n";
-    destroy(head);
-    // cout << "~~~Leaving Destructor~~~\n";
+    clear();
 }
 
 
 template <typename keytype, typename valuetype>
 void BHeap<keytype, valuetype>::destroy(BNode<keytype, valuetype>* bnode){
-    if (bnode != nullptr) {
-        destroy(bnode->child);
-        bnode->child = nullptr;
-        destroy(bnode->sibling);
-        bnode->sibling = nullptr;
-        // cout << "Deleting bnode with key = " << bnode->key << endl;
-        delete bnode;
+    if (bnode == nullptr) {
+        return;
+    }
+    CDA<BNode<keytype, valuetype>*, UncheckedIndex> chains;
+    chains.AddEnd(bnode);
+    while (chains.Length() > 0) {
+        BNode<keytype, valuetype>* curr = chains[chains.Length() - 1];
+        chains.DelEnd();
+        while (curr != nullptr) {
+            BNode<keytype, valuetype>* next = curr->sibling;
+            if (curr->child != nullptr) {
+                chains.AddEnd(curr->child);
+            }
+            curr->child = nullptr;
+            curr->sibling = nullptr;
+            releaseBNode(curr);
+            curr = next;
+        }
     }
 }
 
 
-#endif
\ No newline at end of file
+template <typename keytype, typename valuetype>
+void BHeap<keytype, valuetype>::clear() {
+    // Trivially destructible nodes are not visited at all, freeing the slabs is enough.
+    if (!std::is_trivially_destructible<BNode<keytype, valuetype>>::value) {
+        destroy(head);
+    }
+    pool_.releaseAll();
+    handle_pool_.releaseAll();
+    head = nullptr;
+    min_ = nullptr;
+    tail_ = nullptr;
+}
+
+
+#endif
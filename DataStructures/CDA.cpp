@@ -4,12 +4,36 @@
  * This file contains one class:
  * 1. CDA
  * 
- * This class is templated, and takes one typename,
- * referred to as "T" throughout the code.
+ * This class is templated, and takes two typenames:
+ * the element type, referred to as "T" throughout the code,
+ * and an IndexPolicy (CheckedIndex, UncheckedIndex or
+ * DebugAssertIndex) that decides at compile time what
+ * operator[] does with an out of bounds index.
  * 
- * The only library required for this class to work properly
- * is <cstdlib>, which contains rand(), which is used by QuickSort
- * to pick random pivot elements.
+ * <cstdlib> provides rand(), which is used by QuickSelect
+ * to pick random pivot elements. <iostream> is only used
+ * by the CheckedIndex policy, and <stdexcept> by at().
+ * 
+ * Define CDA_ENABLE_STATS before including this file to count
+ * resizes, bytes moved, comparisons and swaps (see CDAStats.cpp).
+ * 
+ * The sorting, selection and searching code lives in
+ * CDAAlgorithms.cpp, where it is shared with FixedCDA.
+ * 
+ * Every buffer is aligned to a cache line (kCDAAlignment bytes),
+ * so a caller that lays out its elements in cache line sized
+ * groups (e.g. the children of a d-ary Heap node) can rely on
+ * each group occupying exactly one line.
+ * 
+ * Copies are copy-on-write: a copy shares the buffer of the
+ * original, with an atomic reference count kept in a header in
+ * front of the buffer, so copying is O(1). Whichever CDA writes
+ * first to a shared buffer (through a non-const operator[], at,
+ * Linearize, AddEnd, AddFront or a sort) gets a private copy of
+ * the buffer first, and the last one to let go frees it. Reads
+ * through a const CDA never copy. Copies may be read and released
+ * on different threads, but a reference or pointer taken from a
+ * CDA before it was copied must not be written through afterwards.
  * 
  * 
  * @author      Stephen Gregory
@@ -19,10 +43,59 @@
 #ifndef CDA_CPP
 #define CDA_CPP
 
+#include <atomic>
+#include <cassert>
+#include <cstddef>
 #include <cstdlib> // Only used for rand()
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include "CDAAlgorithms.cpp"
+#include "CDAStats.cpp"
+
+
+// CheckedIndex reports an out of bounds index and hands back a sentinel
+// element instead of touching memory outside of the CDA. This is the default.
+struct CheckedIndex {
+    static bool InBounds(int index, int length) {
+        if (index < 0 || index > length - 1) {
+            std::cout << "Error. Index is out of bounds. " << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+
+// UncheckedIndex trusts the caller completely. The check compiles away,
+// leaving operator[] as a single load, which is what internal callers
+// that already know their indices are valid (e.g. Heap) should use.
+struct UncheckedIndex {
+    static bool InBounds(int, int) {
+        return true;
+    }
+};
+
+
+// DebugAssertIndex asserts on an out of bounds index in debug builds
+// and behaves like UncheckedIndex when NDEBUG is defined.
+struct DebugAssertIndex {
+    static bool InBounds(int index, int length) {
+        assert(index >= 0 && index < length);
+        (void)index;
+        (void)length;
+        return true;
+    }
+};
+
+
+// Alignment, in bytes, of every CDA buffer: one cache line.
+const std::size_t kCDAAlignment = 64;
+
 
 // CDA is a Circular Dynamic Array 
-template <typename T>
+template <typename T, typename IndexPolicy = CheckedIndex>
 class CDA {
     public:
 
@@ -31,33 +104,40 @@ class CDA {
         CDA(const CDA &cda);                                // Copy Constructor.
         CDA& operator=(const CDA &cda);                     // Copy Assignment Operator.
         T& operator[](int index);                           // Overloaded Bracket Operator, so CDA can be indexed like a regular array.
+        const T& operator[](int index) const;               // Read only indexing, never copies a shared buffer.
+        T& at(int index);                                   // Bounds checked access, throws std::out_of_range regardless of IndexPolicy.
+        T* Linearize();                                     // Make the elements contiguous in the buffer and return a pointer to the first.
 
         void AddEnd(T v);                                   // Add an element v to the end of the CDA.
         void AddFront(T v);                                 // Add an element v to the front of the CDA.
         void DelEnd();                                      // Delete the element at the end of the CDA.
+        void DelEnd(int count);                             // Delete count elements from the end, shrinking the buffer at most once.
         void DelFront();                                    // Delete the element at the front of the CDA.
         void upsize();                                      // Helper function to double the size of the CDA.
         void downsize();                                    // Helper function to half the size of the CDA.
 
-        int Length();                                       // Return the number of elements in the CDA.
+        int Length() const;                                 // Return the number of elements in the CDA.
         int Capacity();                                     // Return the total allocated capacity of the CDA.
         void Clear();                                       // Clear all of the elements in the CDA.
         bool Ordered();                                     // Returns true if the CDA is ordered, false otherwise.
         int SetOrdered();                                   // Check if the CDA is ordered, and assign is_ordered_ accordingly.
+        void ClearOrdered();                                // Mark the CDA as unordered without checking, O(1).
 
         T Select(int k);                                    // Return the kth smallest element in the CDA
         T QuickSelect(int k);                               // Helper function to find the kth smallest element in the CDA (calls QuickSelectReal).
         T QuickSelectReal(int left, int right, int k);      // Helper function using QuickSelect to find the kth smallest element in the CDA .
-        int getMedianOfThreePivot(T low, T mid, T high);    // Find a random pivot element between indexes left and right.
+        T getMedianOfThreePivot(T low, T mid, T high);      // Return the median of three pivot candidates.
         int getMedianOfThreeIndex(T low, int low_index, T mid, int mid_index, T high, int high_index);
         void QuickSortReal(int low, int high);              // Sort the CDA using Quick Sort (Switches to InsertionSortSubset).
         void QuickSort();                                   // Sort the CDA (Calls QuickSortReal).
         void InsertionSort();                               // Sort the CDA using Insertion Sort.
-        void InsertionSortSubset(int low, int high);        // Sort a subset of the CDA using Insertion Sort.
+        void InsertionSortSubset(int low, int high);        // Sort elements low through high (inclusive) using Insertion Sort.
         void CountingSort(int m);                           // Sort the CDA using Counting Sort.
         int Search(T e);                                    // Returns the index of the element e.
         int BinarySearch(T e, int left, int right);         // Helper function to get the index of the element e when CDA is sorted.
         int LinearSearch(T e);                              // Helper function to get the index of the element e when CDA is unsorted.
+        CDAStats Stats();                                   // Snapshot of this CDA's operation counters (all zero unless CDA_ENABLE_STATS).
+        void ResetStats();                                  // Zero this CDA's operation counters.
         ~CDA();
 
     private:
@@ -68,80 +148,143 @@ class CDA {
         int front_;                                         // The index of the "first" item of the array (as viewed externally).
         T *my_array_;                                       // Pointer to our dynamic array of T objects.
         T throw_away_;                                      // Sentinel value used when the user attempts to access an out of bounds index.
+        CDAStatsCounter<T> stats_;                          // Operation counters, empty no-ops unless CDA_ENABLE_STATS is defined.
+        mutable bool shared_;                               // Another CDA may share my_array_, check before writing to it.
+
+        void reallocate(int new_capacity);                  // Move the elements into a new buffer of new_capacity, front_ becomes 0.
+        void detach();                                      // Give this CDA a buffer of its own if my_array_ is still shared.
+        void releaseBuffer();                               // Drop this CDA's reference to my_array_, freeing it if it was the last.
+        static T* allocateArray(int n);                     // Allocate and default construct a cache line aligned array of n T, with one reference.
+        static void releaseArray(T* array, int n);          // Destroy and free an array from allocateArray.
+        static std::atomic<int>& refCount(T* array);        // The reference count in the header in front of array.
+        static std::size_t arrayAlignment();                // Alignment of every buffer, and size of its header.
 };
 
 
 using namespace std;
 
-template <typename T>
-CDA<T>::CDA() {
+template <typename T, typename IndexPolicy>
+CDA<T, IndexPolicy>::CDA() {
     length_ = 0;
     capacity_ = 1;
     is_ordered_ = false;
     front_ = 0;
-    my_array_ = new T[capacity_];
+    shared_ = false;
+    my_array_ = allocateArray(capacity_);
+    stats_.Allocated(capacity_);
 }
 
 
-template <typename T>
-CDA<T>::CDA(int s) {
+template <typename T, typename IndexPolicy>
+CDA<T, IndexPolicy>::CDA(int s) {
     length_ = s;
     capacity_ = s;
     is_ordered_ = false;
-    my_array_ = new T[capacity_];
+    front_ = 0;
+    shared_ = false;
+    my_array_ = allocateArray(capacity_);
+    stats_.Allocated(capacity_);
 }
 
 
 // Copy Constructor
-template <typename T>
-CDA<T>::CDA(const CDA<T> &cda) {
+template <typename T, typename IndexPolicy>
+CDA<T, IndexPolicy>::CDA(const CDA<T, IndexPolicy> &cda) {
     length_ = cda.length_;
     capacity_ = cda.capacity_;
     is_ordered_ = cda.is_ordered_;
     front_ = cda.front_;
-    my_array_ = new T[capacity_];
-
-    for (int i = 0; i < capacity_; i++) {
-        my_array_[i] = cda.my_array_[i];
-    }
+    my_array_ = cda.my_array_;
+    refCount(my_array_).fetch_add(1, std::memory_order_relaxed);
+    shared_ = true;
+    cda.shared_ = true;
 }
 
 
 // Copy Assignment Operator
-template <typename T>
-CDA<T>& CDA<T>::operator=(const CDA<T> &cda) {
+template <typename T, typename IndexPolicy>
+CDA<T, IndexPolicy>& CDA<T, IndexPolicy>::operator=(const CDA<T, IndexPolicy> &cda) {
+    if (this == &cda) {
+        return *this;
+    }
+    if (my_array_ != cda.my_array_) {
+        releaseBuffer();
+        my_array_ = cda.my_array_;
+        refCount(my_array_).fetch_add(1, std::memory_order_relaxed);
+    }
     length_ = cda.length_;
     capacity_ = cda.capacity_;
     is_ordered_ = cda.is_ordered_;
     front_ = cda.front_;
-    delete[] my_array_;
-    my_array_ = new T[capacity_];
-
-    for (int i = 0; i < cda.capacity_; i++) {
-        my_array_[i] = cda.my_array_[i];
-    }
+    shared_ = true;
+    cda.shared_ = true;
 
     return *this;
 }
 
 
-template <typename T>
-T& CDA<T>::operator[](int index) {
-    if (index < 0 || index > length_ - 1) {
-        std::cout << "Error. Index is out of bounds. " << endl;
+template <typename T, typename IndexPolicy>
+T& CDA<T, IndexPolicy>::operator[](int index) {
+    if (!IndexPolicy::InBounds(index, length_)) {
         return throw_away_;
     }
+    if (shared_) {
+        detach();
+    }
 
     T* my_pointer = &my_array_[((front_ + index) % capacity_)];
     return *my_pointer;
 }
 
 
-template <typename T>
-void CDA<T>::AddEnd(T v) {
+template <typename T, typename IndexPolicy>
+const T& CDA<T, IndexPolicy>::operator[](int index) const {
+    if (!IndexPolicy::InBounds(index, length_)) {
+        return throw_away_;
+    }
+    return my_array_[((front_ + index) % capacity_)];
+}
+
+
+template <typename T, typename IndexPolicy>
+T& CDA<T, IndexPolicy>::at(int index) {
+    if (index < 0 || index > length_ - 1) {
+        throw std::out_of_range("CDA::at index is out of bounds");
+    }
+    if (shared_) {
+        detach();
+    }
+    return my_array_[((front_ + index) % capacity_)];
+}
+
+
+template <typename T, typename IndexPolicy>
+T* CDA<T, IndexPolicy>::Linearize() {
+    if (shared_) {
+        detach();
+    }
+    if (front_ + length_ > capacity_) {
+        // The elements wrap around the end of the buffer, unroll them.
+        T *my_new_array = allocateArray(capacity_);
+        for (int i = 0; i < length_; i++) {
+            my_new_array[i] = std::move(my_array_[(front_ + i) % capacity_]);
+        }
+        releaseArray(my_array_, capacity_);
+        my_array_ = my_new_array;
+        front_ = 0;
+    }
+    return my_array_ + front_;
+}
+
+
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::AddEnd(T v) {
     if (length_ == capacity_) {
         upsize();
     }
+    else if (shared_) {
+        detach();
+    }
     
     if (is_ordered_) {
         if (my_array_[(front_ + length_ - 1) % capacity_] > v) {
@@ -149,13 +292,13 @@ void CDA<T>::AddEnd(T v) {
         }
     }
 
-    my_array_[((front_ + length_) % capacity_)] = v;
+    my_array_[((front_ + length_) % capacity_)] = std::move(v);
     length_++;
 }
 
 
-template <typename T>
-void CDA<T>::AddFront(T v) {
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::AddFront(T v) {
 
     if (is_ordered_) {
         if (my_array_[front_] < v) {
@@ -166,173 +309,187 @@ void CDA<T>::AddFront(T v) {
     if (length_ == capacity_) {
         upsize();
     }
+    else if (shared_) {
+        detach();
+    }
     if (front_ == 0) {
         front_ = capacity_ - 1;
     }
     else {
         front_--;
     }
-    my_array_[front_] = v;
+    my_array_[front_] = std::move(v);
     length_++;
 
 }
 
 
-template <typename T>
-void CDA<T>::DelEnd() {
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::DelEnd() {
     length_--;
 
-    if (length_ <= (capacity_/4)) {
+    if (capacity_ > 1 && length_ <= (capacity_/4)) {
         downsize();
     }
 }
 
 
-template <typename T>
-void CDA<T>::DelFront() {
+// Deleting one element at a time could halve the buffer several times
+// over a big batch. Work out the final capacity first and resize once.
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::DelEnd(int count) {
+    if (count > length_) {
+        count = length_;
+    }
+    if (count <= 0) {
+        return;
+    }
+    length_ -= count;
+
+    int new_capacity = capacity_;
+    while (new_capacity > 1 && length_ <= (new_capacity/4)) {
+        new_capacity = new_capacity / 2;
+    }
+    if (new_capacity != capacity_) {
+        reallocate(new_capacity);
+    }
+}
+
+
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::DelFront() {
     front_ = (front_ + 1) % capacity_;
     length_--;
 
-    if (length_ <= (capacity_/4)) {
+    if (capacity_ > 1 && length_ <= (capacity_/4)) {
         downsize();
     }
 }
 
 
-template <typename T>
-int CDA<T>::Length() {
+template <typename T, typename IndexPolicy>
+int CDA<T, IndexPolicy>::Length() const {
     return length_;
 }
 
 
-template <typename T>
-int CDA<T>::Capacity() {
+template <typename T, typename IndexPolicy>
+int CDA<T, IndexPolicy>::Capacity() {
     return capacity_;
 }
 
 
-template <typename T>
-void CDA<T>::Clear() {
-    delete[] my_array_;
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::Clear() {
+    releaseBuffer();
     length_ = 0;
     capacity_ = 1;
     front_ = 0;
     is_ordered_ = false;
-    my_array_ = new T[capacity_];
+    shared_ = false;
+    my_array_ = allocateArray(capacity_);
+    stats_.Allocated(capacity_);
 }
 
 
-template <typename T>
-void CDA<T>::upsize() {
-    T *my_new_array = new T[capacity_ * 2];
-        
-    for (int i = 0; i < length_; i++) {
-        my_new_array[i] = my_array_[(front_ + i) % capacity_];
-    }
-    capacity_ *= 2;
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::upsize() {
+    reallocate(capacity_ * 2);
+}
 
-    delete[] my_array_;
-    my_array_ = my_new_array;
 
-    front_ = 0;
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::downsize() {
+    reallocate(capacity_ / 2);
 }
 
 
-template <typename T>
-void CDA<T>::downsize() {
-    T *my_new_array = new T[capacity_ / 2];
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::reallocate(int new_capacity) {
+    T *my_new_array = allocateArray(new_capacity);
 
-    for (int i = 0; i < length_; i++) {
-        my_new_array[i] = my_array_[(front_ + i) % capacity_];
+    // Elements of a buffer that other CDAs still use can only be copied.
+    if (shared_ && refCount(my_array_).load(std::memory_order_acquire) > 1) {
+        for (int i = 0; i < length_; i++) {
+            my_new_array[i] = my_array_[(front_ + i) % capacity_];
+        }
+    }
+    else {
+        for (int i = 0; i < length_; i++) {
+            my_new_array[i] = std::move(my_array_[(front_ + i) % capacity_]);
+        }
     }
-    capacity_ = capacity_ / 2;
-    delete[] my_array_;
+    releaseBuffer();
+    shared_ = false;
+    if (new_capacity != capacity_) {
+        stats_.Resized((long long)length_ * sizeof(T), new_capacity);
+    }
+    capacity_ = new_capacity;
     my_array_ = my_new_array;
 
+    front_ = 0;
 }
 
 
-template <typename T>
-bool CDA<T>::Ordered() {
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::detach() {
+    if (refCount(my_array_).load(std::memory_order_acquire) > 1) {
+        reallocate(capacity_);
+    }
+    // Either the copy was made, or every other CDA has let go already.
+    shared_ = false;
+}
+
+
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::releaseBuffer() {
+    if (refCount(my_array_).fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        releaseArray(my_array_, capacity_);
+    }
+}
+
+
+template <typename T, typename IndexPolicy>
+bool CDA<T, IndexPolicy>::Ordered() {
     return is_ordered_;
 }
 
 
-template <typename T>
-int CDA<T>::SetOrdered() {
-   for (int i = 0; i < length_ - 1; i++) {
-       if (my_array_[((front_ + i) % capacity_)] > my_array_[(((front_ + i) + 1) % capacity_)]) {
-           is_ordered_ = false;
-           return  -1;
-       }
+template <typename T, typename IndexPolicy>
+int CDA<T, IndexPolicy>::SetOrdered() {
+    if (!RingIsOrdered(my_array_, front_, capacity_, length_)) {
+        is_ordered_ = false;
+        return -1;
     }
     is_ordered_ = true;
     return 1;
 }
 
 
-template <typename T>
-void CDA<T>::QuickSort() {
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::ClearOrdered() {
+    is_ordered_ = false;
+}
+
+
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::QuickSort() {
     QuickSortReal(0, length_ - 1);
     is_ordered_ = true;
 } 
 
 
-template <typename T>
-void CDA<T>::QuickSortReal(int left, int right) {
-
-    if (left >= right) {
-        return;
-    }
-    if ((right - left) <= 16) {
-        InsertionSortSubset(left, right);
-        return;
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::QuickSortReal(int left, int right) {
+    if (shared_) {
+        detach();
     }
+    RingQuickSort(my_array_, front_, capacity_, left, right, stats_);
+}
 
-    int i = left;
-    int j = right;
-    T tmp;
-
-    // Find pivot with median of 3 technique
-    int low_index = (front_ + left) % capacity_;
-    int mid_index = (front_ + ((left + right) / 2)) % capacity_;
-    int high_index = (front_ + right) % capacity_;
-
-    T low_pivot = my_array_[low_index];
-    T mid_pivot = my_array_[mid_index];
-    T high_pivot = my_array_[high_index];
-
-    T pivot = getMedianOfThreePivot(low_pivot, mid_pivot, high_pivot);
-    int pivot_index = getMedianOfThreeIndex(low_pivot, low_index, mid_pivot, mid_index, high_pivot, high_index);
- 
-    /* partition */
-    while (i <= j) {
-        while (my_array_[(front_ + i) % capacity_] < pivot)
-            i++;
-        while (my_array_[(front_ + j) % capacity_] > pivot)
-            j--;
-            if (i <= j) {
-                tmp = my_array_[(front_ + i) % capacity_];
-                my_array_[(front_ + i) % capacity_] = my_array_[(front_ + j) % capacity_];
-                my_array_[(front_ + j) % capacity_] = tmp;
-                i++;
-                j--;
-            }
-    };
-    tmp = my_array_[(front_ + i + 1) % capacity_];
-    my_array_[(front_ + i + 1) % capacity_] = my_array_[pivot_index];
-    my_array_[pivot_index] = tmp;
-
-    /* recursion */
-    if (left < j)
-        QuickSortReal(left, j);
-    if (i < right)
-        QuickSortReal(i, right);
-}
-
-
-template <typename T>
-T CDA<T>::Select(int k) {
+
+template <typename T, typename IndexPolicy>
+T CDA<T, IndexPolicy>::Select(int k) {
     if (SetOrdered() == 1) {
         return my_array_[(front_ + (k - 1)) % capacity_];
     }
@@ -342,41 +499,20 @@ T CDA<T>::Select(int k) {
 }
 
 
-template <typename T>
-T CDA<T>::QuickSelect(int k) {
+template <typename T, typename IndexPolicy>
+T CDA<T, IndexPolicy>::QuickSelect(int k) {
     return QuickSelectReal(0, length_ - 1, k - 1);
 }
 
 
-template <typename T>
-int CDA<T>::getMedianOfThreePivot(T low, T mid, T high) {
-    if (low < mid) {
-        if (high < low) {
-            return low;
-        }
-        else if (high < mid) {
-            return high;
-        }
-        else {
-            return mid;
-        }
-    }
-    else {
-        if (high < mid) {
-            return mid;
-        }
-        else if (high < low) {
-            return high;
-        }
-        else {
-            return low;
-        }
-    }
+template <typename T, typename IndexPolicy>
+T CDA<T, IndexPolicy>::getMedianOfThreePivot(T low, T mid, T high) {
+    return MedianOfThree(low, mid, high);
 }
 
 
-template <typename T>
-int CDA<T>::getMedianOfThreeIndex(T low, int low_index, T mid, int mid_index, T high, int high_index) {
+template <typename T, typename IndexPolicy>
+int CDA<T, IndexPolicy>::getMedianOfThreeIndex(T low, int low_index, T mid, int mid_index, T high, int high_index) {
     if (low < mid) {
         if (high < low) {
             return low_index;
@@ -402,92 +538,41 @@ int CDA<T>::getMedianOfThreeIndex(T low, int low_index, T mid, int mid_index, T
 }
 
 
-template <typename T>
-T CDA<T>::QuickSelectReal(int left, int right, int k) {
-    int pivot_position;
-    int i = left - 1;
-    int j = right;
-    T tmp;
-    
-    if (i == j) {
-        return my_array_[(front_ + i) % capacity_];
+template <typename T, typename IndexPolicy>
+T CDA<T, IndexPolicy>::QuickSelectReal(int left, int right, int k) {
+    if (shared_) {
+        detach();
     }
+    // Random pivots keep adversarial inputs from forcing quadratic behavior.
+    auto random_pivot = [](int low, int high) { return low + (rand() % (high - low + 1)); };
+    return RingQuickSelect(my_array_, front_, capacity_, left, right, k, random_pivot, stats_);
+}
 
-    pivot_position = left + (rand() % (right - left + 1));
-
-    T pivot = my_array_[(front_ + pivot_position) % capacity_];
-    tmp = my_array_[(front_ + pivot_position) % capacity_];
-
-    /* partition */
-    while (i <= j) {
-        while (my_array_[(front_ + i) % capacity_] < pivot) {
-            i++;
-        }
-        while (my_array_[(front_ + j) % capacity_] > pivot) {
-            j--;
-        }
-        if (i <= j) {
-                tmp = my_array_[(front_ + i) % capacity_];
-                my_array_[(front_ + i) % capacity_] = my_array_[(front_ + j) % capacity_];
-                my_array_[(front_ + j) % capacity_] = tmp;
-                i++;
-                j--;
-            }
-    };
-    tmp = my_array_[(front_ + i + 1) % capacity_];
-    my_array_[(front_ + i + 1) % capacity_] = my_array_[(front_ + pivot_position) % capacity_];
-    my_array_[(front_ + pivot_position) % capacity_] = tmp;
-
-    if (pivot_position == k) {
-        return my_array_[(front_ + k) % capacity_];
-    }
-
-    // If k is less than index of current pivot, recurse on left
-    if (k < pivot_position) {
-        return QuickSelectReal(left, j, k);
-    }
-    // If k is greater than index if current pivot, recurse on right
-    return QuickSelectReal(i, right, k);
-} 
-
-
-template <typename T>
-void CDA<T>::InsertionSort() {
-    int i, j;
-    T key;
 
-    for (i = 1; i < length_; i++) {
-        key = my_array_[(front_ + i) % capacity_];
-        j = i - 1;
-        while (j >= 0 && my_array_[(front_ + j) % capacity_] > key) {
-            my_array_[(front_ + j + 1) % capacity_] = my_array_[(front_ + j) % capacity_];
-            j--;
-        }
-        my_array_[(front_ + j + 1) % capacity_] = key;
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::InsertionSort() {
+    if (shared_) {
+        detach();
     }
+    RingInsertionSort(my_array_, front_, capacity_, 0, length_ - 1, stats_);
     is_ordered_ = true;
 }
 
 
-template <typename T>
-void CDA<T>::InsertionSortSubset(int low, int high) {
-    int j;
-    T key;
-
-    for (int i = low; i < high; i++) {
-        key = my_array_[(front_ + i) % capacity_];
-        j = i - 1;
-        while (j >= 0 && my_array_[(front_ + j) % capacity_] > key) {
-            my_array_[(front_ + j + 1) % capacity_] = my_array_[(front_ + j) % capacity_];
-            j--;
-        }
-        my_array_[(front_ + j + 1) % capacity_] = key;
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::InsertionSortSubset(int low, int high) {
+    if (shared_) {
+        detach();
     }
+    RingInsertionSort(my_array_, front_, capacity_, low, high, stats_);
 }
 
 
-template <typename T>
-void CDA<T>::CountingSort(int m) {
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::CountingSort(int m) {
+    if (shared_) {
+        detach();
+    }
 
     int i;
     int count_array[m+1];
@@ -530,8 +615,8 @@ void CDA<T>::CountingSort(int m) {
 } 
 
 
-template <typename T>
-int CDA<T>::Search(T e) {
+template <typename T, typename IndexPolicy>
+int CDA<T, IndexPolicy>::Search(T e) {
     if (is_ordered_) {
         return BinarySearch(e, 0, length_ - 1);
     }
@@ -542,48 +627,81 @@ int CDA<T>::Search(T e) {
 }
 
 
-template <typename T>
-int CDA<T>::BinarySearch(T e, int left, int right) {
+template <typename T, typename IndexPolicy>
+int CDA<T, IndexPolicy>::BinarySearch(T e, int left, int right) {
+    return RingBinarySearch(my_array_, front_, capacity_, e, left, right);
+}
 
-    if (right >= left) { 
-        int middle = left + (right - left) / 2; 
-  
-        // If the element is present at the middle index
-        if (my_array_[(front_ + middle) % capacity_] == e) {
-            return middle; 
-        }
-  
-        // If element is smaller than mid, then 
-        // it must be in the left subarray
-        if (my_array_[(front_ + middle) % capacity_] > e) {
-            return BinarySearch(e, left, middle - 1); 
-        }
 
-        // Otherwise, the element must be somewhere
-        // in right subarray 
-        return BinarySearch(e, middle + 1, right); 
-    } 
-  
-    // We reach here when element is not 
-    // present in array 
-    return -1; 
+template <typename T, typename IndexPolicy>
+int CDA<T, IndexPolicy>::LinearSearch(T e) {
+    return RingLinearSearch(my_array_, front_, capacity_, e, length_);
 }
 
 
-template <typename T>
-int CDA<T>::LinearSearch(T e) {
-    for (int i = 0; i < length_; i++) {
-        if (my_array_[(front_ + i) % capacity_] == e) {
-            return i;
+template <typename T, typename IndexPolicy>
+CDAStats CDA<T, IndexPolicy>::Stats() {
+    return stats_.Snapshot();
+}
+
+
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::ResetStats() {
+    stats_.Reset();
+}
+
+
+template <typename T, typename IndexPolicy>
+T* CDA<T, IndexPolicy>::allocateArray(int n) {
+    // One alignment's worth of header in front of the elements holds the
+    // reference count, and keeps the elements themselves aligned.
+    const std::align_val_t alignment = std::align_val_t(arrayAlignment());
+    char* block = static_cast<char*>(::operator new[](arrayAlignment() + sizeof(T) * n, alignment));
+    new (block) std::atomic<int>(1);
+    T* array = reinterpret_cast<T*>(block + arrayAlignment());
+    int constructed = 0;
+    try {
+        for (; constructed < n; constructed++) {
+            new (array + constructed) T;
         }
     }
-    return -1;
+    catch (...) {
+        while (constructed > 0) {
+            array[--constructed].~T();
+        }
+        ::operator delete[](block, alignment);
+        throw;
+    }
+    return array;
+}
+
+
+template <typename T, typename IndexPolicy>
+void CDA<T, IndexPolicy>::releaseArray(T* array, int n) {
+    const std::align_val_t alignment = std::align_val_t(arrayAlignment());
+    for (int i = 0; i < n; i++) {
+        array[i].~T();
+    }
+    refCount(array).~atomic();
+    ::operator delete[](reinterpret_cast<char*>(array) - arrayAlignment(), alignment);
+}
+
+
+template <typename T, typename IndexPolicy>
+std::atomic<int>& CDA<T, IndexPolicy>::refCount(T* array) {
+    return *reinterpret_cast<std::atomic<int>*>(reinterpret_cast<char*>(array) - arrayAlignment());
+}
+
+
+template <typename T, typename IndexPolicy>
+std::size_t CDA<T, IndexPolicy>::arrayAlignment() {
+    return alignof(T) > kCDAAlignment ? alignof(T) : kCDAAlignment;
 }
 
 
-template <typename T>
-CDA<T>::~CDA() {
-    delete[] my_array_;
+template <typename T, typename IndexPolicy>
+CDA<T, IndexPolicy>::~CDA() {
+    releaseBuffer();
 }
 
 
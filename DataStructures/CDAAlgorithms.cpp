@@ -0,0 +1,208 @@
+/*
+ * Sorting, selection and searching over a circular buffer.
+ *
+ * These are the algorithms behind CDA and FixedCDA, written once
+ * as constexpr function templates so that the runtime CDA and the
+ * compile-time FixedCDA share the same code. Every function works
+ * on a "ring": a buffer data[0..capacity-1] whose logical element i
+ * lives at data[(front + i) % capacity]. All index arguments are
+ * logical indices.
+ *
+ * The stats argument receives a Compared() call for every element
+ * comparison and a Swapped() call for every swap. Pass a
+ * CDAStatsCounter to count them, or NoCDAStats to count nothing.
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef CDA_ALGORITHMS_CPP
+#define CDA_ALGORITHMS_CPP
+
+
+// NoCDAStats ignores every hook. It is usable in constant expressions.
+struct NoCDAStats {
+    constexpr bool Compared(bool result) { return result; }
+    constexpr void Swapped() {}
+};
+
+
+// Return a reference to logical element i of the ring.
+template <typename T>
+constexpr T& RingAt(T* data, int front, int capacity, int i) {
+    return data[(front + i) % capacity];
+}
+
+
+template <typename T, typename Stats>
+constexpr void RingSwap(T* data, int front, int capacity, int a, int b, Stats &stats) {
+    T tmp = RingAt(data, front, capacity, a);
+    RingAt(data, front, capacity, a) = RingAt(data, front, capacity, b);
+    RingAt(data, front, capacity, b) = tmp;
+    stats.Swapped();
+}
+
+
+// Return whichever of low, mid and high is the median value.
+template <typename T>
+constexpr T MedianOfThree(T low, T mid, T high) {
+    if (low < mid) {
+        if (high < low) {
+            return low;
+        }
+        else if (high < mid) {
+            return high;
+        }
+        else {
+            return mid;
+        }
+    }
+    else {
+        if (high < mid) {
+            return mid;
+        }
+        else if (high < low) {
+            return high;
+        }
+        else {
+            return low;
+        }
+    }
+}
+
+
+// Sort logical elements [low, high] (inclusive) with Insertion Sort.
+template <typename T, typename Stats>
+constexpr void RingInsertionSort(T* data, int front, int capacity, int low, int high, Stats &stats) {
+    for (int i = low + 1; i <= high; i++) {
+        T key = RingAt(data, front, capacity, i);
+        int j = i - 1;
+        while (j >= low && stats.Compared(RingAt(data, front, capacity, j) > key)) {
+            RingAt(data, front, capacity, j + 1) = RingAt(data, front, capacity, j);
+            j--;
+        }
+        RingAt(data, front, capacity, j + 1) = key;
+    }
+}
+
+
+// Hoare partition of logical elements [left, right] around the value pivot.
+// On return, everything in [left, j] is <= pivot, everything in [i, right]
+// is >= pivot, and everything strictly between j and i equals pivot.
+template <typename T, typename Stats>
+constexpr void RingPartition(T* data, int front, int capacity, int left, int right, T pivot, int &i, int &j, Stats &stats) {
+    i = left;
+    j = right;
+    while (i <= j) {
+        while (stats.Compared(RingAt(data, front, capacity, i) < pivot)) {
+            i++;
+        }
+        while (stats.Compared(RingAt(data, front, capacity, j) > pivot)) {
+            j--;
+        }
+        if (i <= j) {
+            RingSwap(data, front, capacity, i, j, stats);
+            i++;
+            j--;
+        }
+    }
+}
+
+
+// Sort logical elements [left, right] (inclusive) with Quick Sort, using a
+// median of three pivot and switching to Insertion Sort for small ranges.
+template <typename T, typename Stats>
+constexpr void RingQuickSort(T* data, int front, int capacity, int left, int right, Stats &stats) {
+    while (right - left > 16) {
+        T pivot = MedianOfThree(RingAt(data, front, capacity, left),
+                                RingAt(data, front, capacity, left + (right - left) / 2),
+                                RingAt(data, front, capacity, right));
+        int i = left;
+        int j = right;
+        RingPartition(data, front, capacity, left, right, pivot, i, j, stats);
+
+        // Recurse on the smaller side and loop on the larger one,
+        // which keeps the recursion depth logarithmic.
+        if (j - left < right - i) {
+            RingQuickSort(data, front, capacity, left, j, stats);
+            left = i;
+        }
+        else {
+            RingQuickSort(data, front, capacity, i, right, stats);
+            right = j;
+        }
+    }
+    RingInsertionSort(data, front, capacity, left, right, stats);
+}
+
+
+// Return the kth smallest (0-based) of logical elements [left, right],
+// partially reordering them. choose_pivot(left, right) returns the logical
+// index of the element to partition around.
+template <typename T, typename PivotChooser, typename Stats>
+constexpr T RingQuickSelect(T* data, int front, int capacity, int left, int right, int k, PivotChooser choose_pivot, Stats &stats) {
+    while (left < right) {
+        T pivot = RingAt(data, front, capacity, choose_pivot(left, right));
+        int i = left;
+        int j = right;
+        RingPartition(data, front, capacity, left, right, pivot, i, j, stats);
+
+        if (k <= j) {
+            right = j;
+        }
+        else if (k >= i) {
+            left = i;
+        }
+        else {
+            break;
+        }
+    }
+    return RingAt(data, front, capacity, k);
+}
+
+
+// Return the logical index of e in sorted logical elements [left, right], or -1.
+template <typename T>
+constexpr int RingBinarySearch(const T* data, int front, int capacity, T e, int left, int right) {
+    while (left <= right) {
+        int middle = left + (right - left) / 2;
+        if (RingAt(data, front, capacity, middle) == e) {
+            return middle;
+        }
+        if (RingAt(data, front, capacity, middle) > e) {
+            right = middle - 1;
+        }
+        else {
+            left = middle + 1;
+        }
+    }
+    return -1;
+}
+
+
+// Return the logical index of the first occurrence of e among the first length elements, or -1.
+template <typename T>
+constexpr int RingLinearSearch(const T* data, int front, int capacity, T e, int length) {
+    for (int i = 0; i < length; i++) {
+        if (RingAt(data, front, capacity, i) == e) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// Return true if the first length logical elements are in non-decreasing order.
+template <typename T>
+constexpr bool RingIsOrdered(const T* data, int front, int capacity, int length) {
+    for (int i = 0; i < length - 1; i++) {
+        if (RingAt(data, front, capacity, i) > RingAt(data, front, capacity, i + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * Operation counters for the Circular Dynamic Array (CDA).
+ *
+ * This file contains four classes:
+ * 1. CDAStats
+ * 2. CDAStatsCounterBase
+ * 3. CDAStatsCounter
+ * 4. CDAStatsRegistry
+ *
+ * Counting is opt-in and decided at compile time. Define
+ * CDA_ENABLE_STATS before including CDA.cpp to turn the counters
+ * on. Without it, CDAStatsCounter is an empty class whose methods
+ * are inline no-ops, so a CDA pays nothing for them.
+ *
+ * When enabled, every CDA registers its counter with the
+ * process-wide CDAStatsRegistry, which keeps per element type
+ * totals (live CDAs plus the ones that have already been
+ * destroyed) and can dump them as JSON. The counters themselves
+ * are plain integers, so take registry snapshots at a point where
+ * no other thread is modifying a CDA.
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef CDA_STATS_CPP
+#define CDA_STATS_CPP
+
+#ifdef CDA_ENABLE_STATS
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <typeinfo>
+#endif
+
+
+// CDAStats is a plain snapshot of the counters of one CDA (or a sum of them).
+struct CDAStats {
+    long long resizes;                                  // Number of upsize()/downsize() calls.
+    long long bytes_moved;                              // Bytes copied from the old buffer during resizes.
+    long long comparisons;                              // Element comparisons made by QuickSort/QuickSelect.
+    long long swaps;                                    // Element swaps made by QuickSort/QuickSelect.
+    int peak_capacity;                                  // Largest capacity ever allocated.
+    CDAStats() : resizes(0), bytes_moved(0), comparisons(0), swaps(0), peak_capacity(0) {}
+    CDAStats& operator+=(CDAStats const &rhs) {
+        resizes += rhs.resizes;
+        bytes_moved += rhs.bytes_moved;
+        comparisons += rhs.comparisons;
+        swaps += rhs.swaps;
+        if (rhs.peak_capacity > peak_capacity) {
+            peak_capacity = rhs.peak_capacity;
+        }
+        return *this;
+    }
+};
+
+
+#ifdef CDA_ENABLE_STATS
+
+class CDAStatsCounterBase;
+
+
+// CDAStatsRegistry is the per-process list of every live CDA counter,
+// plus the totals of counters that have already been destroyed.
+class CDAStatsRegistry {
+public:
+    static CDAStatsRegistry& Instance();                // The one registry for this process.
+
+    void Register(CDAStatsCounterBase* counter);        // Called when a CDA is created.
+    void Unregister(CDAStatsCounterBase* counter);      // Called when a CDA is destroyed, folds its totals in.
+    CDAStats Snapshot(const std::string &label);        // Totals for one element type.
+    CDAStats Snapshot();                                // Totals for every CDA in the process.
+    void Reset();                                       // Zero every live counter and all retired totals.
+    void DumpJSON(std::ostream &out);                   // Write the per element type totals as a JSON object.
+
+private:
+    std::map<std::string, CDAStats> totalsByLabel();
+
+    std::mutex mutex_;                                  // Guards live_ and retired_.
+    std::set<CDAStatsCounterBase*> live_;               // Counters of CDAs that still exist.
+    std::map<std::string, CDAStats> retired_;           // Totals of destroyed CDAs, keyed by element type.
+};
+
+
+// CDAStatsCounterBase is the per-CDA set of counters.
+class CDAStatsCounterBase {
+public:
+    explicit CDAStatsCounterBase(const char* label) : label_(label) {
+        CDAStatsRegistry::Instance().Register(this);
+    }
+    CDAStatsCounterBase(const CDAStatsCounterBase &) = delete;
+    CDAStatsCounterBase& operator=(const CDAStatsCounterBase &) = delete;
+    ~CDAStatsCounterBase() {
+        CDAStatsRegistry::Instance().Unregister(this);
+    }
+
+    void Resized(long long bytes, int new_capacity) {
+        stats_.resizes++;
+        stats_.bytes_moved += bytes;
+        Allocated(new_capacity);
+    }
+    void Allocated(int capacity) {
+        if (capacity > stats_.peak_capacity) {
+            stats_.peak_capacity = capacity;
+        }
+    }
+    bool Compared(bool result) {
+        stats_.comparisons++;
+        return result;
+    }
+    void Swapped() {
+        stats_.swaps++;
+    }
+
+    CDAStats Snapshot() const { return stats_; }
+    void Reset() { stats_ = CDAStats(); }
+    const char* Label() const { return label_; }
+
+private:
+    const char* label_;                                 // Element type name, used to group counters in the registry.
+    CDAStats stats_;
+};
+
+
+// CDAStatsCounter labels its counters with the name of the element type T.
+template <typename T>
+class CDAStatsCounter : public CDAStatsCounterBase {
+public:
+    CDAStatsCounter() : CDAStatsCounterBase(typeid(T).name()) {}
+};
+
+
+inline CDAStatsRegistry& CDAStatsRegistry::Instance() {
+    static CDAStatsRegistry registry;
+    return registry;
+}
+
+
+inline void CDAStatsRegistry::Register(CDAStatsCounterBase* counter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_.insert(counter);
+}
+
+
+inline void CDAStatsRegistry::Unregister(CDAStatsCounterBase* counter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    live_.erase(counter);
+    retired_[counter->Label()] += counter->Snapshot();
+}
+
+
+inline std::map<std::string, CDAStats> CDAStatsRegistry::totalsByLabel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, CDAStats> totals = retired_;
+    for (CDAStatsCounterBase* counter : live_) {
+        totals[counter->Label()] += counter->Snapshot();
+    }
+    return totals;
+}
+
+
+inline CDAStats CDAStatsRegistry::Snapshot(const std::string &label) {
+    return totalsByLabel()[label];
+}
+
+
+inline CDAStats CDAStatsRegistry::Snapshot() {
+    CDAStats total;
+    for (auto &entry : totalsByLabel()) {
+        total += entry.second;
+    }
+    return total;
+}
+
+
+inline void CDAStatsRegistry::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    retired_.clear();
+    for (CDAStatsCounterBase* counter : live_) {
+        counter->Reset();
+    }
+}
+
+
+inline void CDAStatsRegistry::DumpJSON(std::ostream &out) {
+    std::map<std::string, CDAStats> totals = totalsByLabel();
+    out << "{";
+    bool first = true;
+    for (auto &entry : totals) {
+        if (!first) {
+            out << ",";
+        }
+        first = false;
+        out << "\"" << entry.first << "\":{"
+            << "\"resizes\":" << entry.second.resizes << ","
+            << "\"bytes_moved\":" << entry.second.bytes_moved << ","
+            << "\"comparisons\":" << entry.second.comparisons << ","
+            << "\"swaps\":" << entry.second.swaps << ","
+            << "\"peak_capacity\":" << entry.second.peak_capacity << "}";
+    }
+    out << "}";
+}
+
+#else
+
+// With CDA_ENABLE_STATS undefined every hook is an empty inline function.
+template <typename T>
+class CDAStatsCounter {
+public:
+    void Resized(long long, int) {}
+    void Allocated(int) {}
+    bool Compared(bool result) { return result; }
+    void Swapped() {}
+    CDAStats Snapshot() const { return CDAStats(); }
+    void Reset() {}
+};
+
+#endif
+
+
+#endif
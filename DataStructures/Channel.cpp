@@ -0,0 +1,397 @@
+/*
+ * Implementation of a Coroutine Channel.
+ *
+ * This file contains three classes:
+ * 1. Task
+ * 2. EventLoop
+ * 3. Channel
+ *
+ * A Channel<T> hands values from producer coroutines to consumer
+ * coroutines through a CDA used as a ring buffer:
+ *
+ *    Task producer(Channel<int> &ch) {
+ *        for (int i = 0; i < 100; i++) {
+ *            co_await ch.push(i);
+ *        }
+ *        ch.close();
+ *    }
+ *
+ *    Task consumer(Channel<int> &ch) {
+ *        while (std::optional<int> v = co_await ch.pop()) {
+ *            ...
+ *        }
+ *    }
+ *
+ *    EventLoop loop;
+ *    Channel<int> ch(loop, 16);
+ *    loop.spawn(producer(ch));
+ *    loop.spawn(consumer(ch));
+ *    loop.run();
+ *
+ * Everything runs on the thread that calls EventLoop::run(). A
+ * coroutine that has to wait (a push into a full bounded channel,
+ * or a pop from an empty one) is parked inside the channel and
+ * put back on the loop's ready queue when the other side makes
+ * progress, so stages are scheduled cooperatively without any
+ * OS threads, locks or condition variables.
+ *
+ * A capacity of 0 means the channel is unbounded and push never
+ * waits. Otherwise push waits while the channel holds capacity
+ * values, which applies backpressure to fast producers.
+ *
+ * A value is moved, never copied, on its way from push to pop:
+ * a parked pusher keeps it in its awaiter, and a parked pop gets
+ * it handed straight into its awaiter, so neither allocates.
+ * Only pop_many collects into a CDA.
+ *
+ * Requires C++20.
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef CHANNEL_CPP
+#define CHANNEL_CPP
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include "CDA.cpp"
+
+
+// Task is a fire-and-forget coroutine that is started by an EventLoop.
+class Task {
+public:
+    struct promise_type {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task(const Task &) = delete;
+    Task& operator=(const Task &) = delete;
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    std::coroutine_handle<> release() { return std::exchange(handle_, nullptr); }   // Give up ownership of the frame.
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    std::coroutine_handle<promise_type> handle_;
+};
+
+
+// EventLoop is a single-threaded scheduler of coroutines.
+class EventLoop {
+public:
+    EventLoop() {}
+    EventLoop(const EventLoop &) = delete;
+    EventLoop& operator=(const EventLoop &) = delete;
+
+    void spawn(Task task);                                  // Take ownership of task and schedule its first run.
+    void schedule(std::coroutine_handle<> handle);          // Resume handle on a later turn of the loop.
+    void run();                                             // Resume ready coroutines until none are left.
+    ~EventLoop();                                           // Destroys every spawned coroutine, finished or not.
+
+private:
+    void reapFinished();                                    // Destroy the frames of spawned coroutines that have finished.
+
+    CDA<std::coroutine_handle<>, UncheckedIndex> ready_;    // FIFO of coroutines waiting to be resumed.
+    CDA<std::coroutine_handle<>, UncheckedIndex> owned_;    // Every spawned coroutine that has not been destroyed.
+};
+
+
+inline void EventLoop::spawn(Task task) {
+    std::coroutine_handle<> handle = task.release();
+    owned_.AddEnd(handle);
+    schedule(handle);
+}
+
+
+inline void EventLoop::schedule(std::coroutine_handle<> handle) {
+    ready_.AddEnd(handle);
+}
+
+
+inline void EventLoop::run() {
+    while (ready_.Length() > 0) {
+        std::coroutine_handle<> handle = ready_[0];
+        ready_.DelFront();
+        handle.resume();
+    }
+    reapFinished();
+}
+
+
+inline void EventLoop::reapFinished() {
+    CDA<std::coroutine_handle<>, UncheckedIndex> still_running;
+    for (int i = 0; i < owned_.Length(); i++) {
+        if (owned_[i].done()) {
+            owned_[i].destroy();
+        }
+        else {
+            still_running.AddEnd(owned_[i]);
+        }
+    }
+    owned_ = still_running;
+}
+
+
+inline EventLoop::~EventLoop() {
+    for (int i = 0; i < owned_.Length(); i++) {
+        owned_[i].destroy();
+    }
+}
+
+
+// Channel is a FIFO of T values between coroutines on one EventLoop
+template <typename T>
+class Channel {
+public:
+    class PushAwaiter;
+    class PopAwaiter;
+    class PopManyAwaiter;
+
+    Channel(EventLoop &loop, int capacity = 0);             // capacity 0 means unbounded.
+    Channel(const Channel &) = delete;
+    Channel& operator=(const Channel &) = delete;
+
+    PushAwaiter push(T v);                                  // co_await yields false if the channel was closed.
+    PopAwaiter pop();                                       // co_await yields the next value, or nothing once closed and empty.
+    PopManyAwaiter pop_many(int max);                       // co_await yields 1 to max values, or none once closed and empty.
+    bool tryPush(T v);                                      // Push without waiting, false if full or closed.
+    std::optional<T> tryPop();                              // Pop without waiting, nothing if empty.
+    void close();                                           // Wake every waiter, later pushes fail.
+    int size();                                             // Number of values buffered in the channel.
+    bool closed();                                          // True once close() has been called.
+
+private:
+    // A coroutine parked in the channel, waiting for space or for values.
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        std::optional<T> value;                             // Pushers: the value to push. pop: the value handed over.
+        CDA<T>* items;                                      // pop_many: values handed over, nullptr for pushers and pop.
+        int max;                                            // Poppers: most values to take.
+        bool ok;                                            // Pushers: false if woken by close().
+    };
+
+    bool full();
+    int received(Waiter &popper);                           // Number of values popper has been handed.
+    void give(Waiter &popper, T &&v);                       // Hand v over to popper.
+    void takeInto(Waiter &popper);                          // Move buffered values into popper, refilling from parked pushers.
+    void wake(Waiter* waiter);
+
+    EventLoop &loop_;
+    CDA<T> buffer_;                                         // Ring of buffered values, front is the oldest.
+    int capacity_;
+    bool closed_;
+    CDA<Waiter*, UncheckedIndex> pushers_;                  // Parked pushers, oldest first.
+    CDA<Waiter*, UncheckedIndex> poppers_;                  // Parked poppers, oldest first.
+
+public:
+    class PushAwaiter {
+    public:
+        PushAwaiter(Channel &channel, T v) : channel_(channel) {
+            waiter_.value.emplace(std::move(v));
+            waiter_.items = nullptr;
+            waiter_.ok = true;
+        }
+        bool await_ready() {
+            if (channel_.closed_) {
+                waiter_.ok = false;
+                return true;
+            }
+            if (channel_.poppers_.Length() > 0) {
+                // Someone is already waiting, hand the value straight over.
+                Waiter* popper = channel_.poppers_[0];
+                channel_.poppers_.DelFront();
+                channel_.give(*popper, std::move(*waiter_.value));
+                channel_.wake(popper);
+                return true;
+            }
+            if (!channel_.full()) {
+                channel_.buffer_.AddEnd(std::move(*waiter_.value));
+                return true;
+            }
+            return false;
+        }
+        void await_suspend(std::coroutine_handle<> handle) {
+            waiter_.handle = handle;
+            channel_.pushers_.AddEnd(&waiter_);
+        }
+        bool await_resume() { return waiter_.ok; }
+    private:
+        Channel &channel_;
+        Waiter waiter_;
+    };
+
+    class PopAwaiter {
+    public:
+        PopAwaiter(Channel &channel) : channel_(channel) {
+            waiter_.items = nullptr;
+            waiter_.max = 1;
+        }
+        bool await_ready() {
+            channel_.takeInto(waiter_);
+            return waiter_.value.has_value() || channel_.closed_;
+        }
+        void await_suspend(std::coroutine_handle<> handle) {
+            waiter_.handle = handle;
+            channel_.poppers_.AddEnd(&waiter_);
+        }
+        std::optional<T> await_resume() { return std::move(waiter_.value); }
+    private:
+        Channel &channel_;
+        Waiter waiter_;
+    };
+
+    class PopManyAwaiter {
+    public:
+        PopManyAwaiter(Channel &channel, int max) : channel_(channel) {
+            waiter_.items = nullptr;
+            waiter_.max = (max < 1) ? 1 : max;
+        }
+        bool await_ready() {
+            // Pointed at items_ only now, once the awaiter sits where it is awaited.
+            waiter_.items = &items_;
+            channel_.takeInto(waiter_);
+            return items_.Length() > 0 || channel_.closed_;
+        }
+        void await_suspend(std::coroutine_handle<> handle) {
+            waiter_.handle = handle;
+            channel_.poppers_.AddEnd(&waiter_);
+        }
+        CDA<T> await_resume() { return items_; }
+    private:
+        Channel &channel_;
+        Waiter waiter_;
+        CDA<T> items_;
+    };
+};
+
+
+template <typename T>
+Channel<T>::Channel(EventLoop &loop, int capacity) : loop_(loop), capacity_(capacity), closed_(false) {
+}
+
+
+template <typename T>
+typename Channel<T>::PushAwaiter Channel<T>::push(T v) {
+    return PushAwaiter(*this, std::move(v));
+}
+
+
+template <typename T>
+typename Channel<T>::PopAwaiter Channel<T>::pop() {
+    return PopAwaiter(*this);
+}
+
+
+template <typename T>
+typename Channel<T>::PopManyAwaiter Channel<T>::pop_many(int max) {
+    return PopManyAwaiter(*this, max);
+}
+
+
+template <typename T>
+bool Channel<T>::tryPush(T v) {
+    PushAwaiter awaiter(*this, std::move(v));
+    return awaiter.await_ready() && awaiter.await_resume();
+}
+
+
+template <typename T>
+std::optional<T> Channel<T>::tryPop() {
+    PopAwaiter awaiter(*this);
+    awaiter.await_ready();
+    return awaiter.await_resume();
+}
+
+
+template <typename T>
+void Channel<T>::close() {
+    closed_ = true;
+    while (poppers_.Length() > 0) {
+        Waiter* popper = poppers_[0];
+        poppers_.DelFront();
+        wake(popper);
+    }
+    while (pushers_.Length() > 0) {
+        Waiter* pusher = pushers_[0];
+        pushers_.DelFront();
+        pusher->ok = false;
+        wake(pusher);
+    }
+}
+
+
+template <typename T>
+int Channel<T>::size() {
+    return buffer_.Length();
+}
+
+
+template <typename T>
+bool Channel<T>::closed() {
+    return closed_;
+}
+
+
+template <typename T>
+bool Channel<T>::full() {
+    return capacity_ > 0 && buffer_.Length() >= capacity_;
+}
+
+
+template <typename T>
+int Channel<T>::received(Waiter &popper) {
+    if (popper.items != nullptr) {
+        return popper.items->Length();
+    }
+    return popper.value.has_value() ? 1 : 0;
+}
+
+
+template <typename T>
+void Channel<T>::give(Waiter &popper, T &&v) {
+    if (popper.items != nullptr) {
+        popper.items->AddEnd(std::move(v));
+    }
+    else {
+        popper.value.emplace(std::move(v));
+    }
+}
+
+
+template <typename T>
+void Channel<T>::takeInto(Waiter &popper) {
+    while (received(popper) < popper.max && buffer_.Length() > 0) {
+        give(popper, std::move(buffer_[0]));
+        buffer_.DelFront();
+
+        // Every value taken frees a slot for the oldest parked pusher.
+        if (pushers_.Length() > 0) {
+            Waiter* pusher = pushers_[0];
+            pushers_.DelFront();
+            buffer_.AddEnd(std::move(*pusher->value));
+            wake(pusher);
+        }
+    }
+}
+
+
+template <typename T>
+void Channel<T>::wake(Waiter* waiter) {
+    loop_.schedule(waiter->handle);
+}
+
+
+#endif
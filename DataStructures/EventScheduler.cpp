@@ -0,0 +1,281 @@
+/*
+ * Implementation of a FIFO-stable Event Scheduler.
+ *
+ * This file contains two classes:
+ * 1. WideEventKey
+ * 2. EventScheduler
+ *
+ * EventScheduler is templated with two typenames, timetype and
+ * eventtype, and queues events in a Heap by the time they are due:
+ *    EventScheduler<long, Event> scheduler;
+ *    EventScheduler<long, Event>::Handle h = scheduler.scheduleAt(10, e);
+ *    scheduler.cancel(h);
+ *    scheduler.runUntil(100, [](long time, Event &event) { ... });
+ *
+ * Events due at the same time fire in the order they were
+ * scheduled. Every event gets a sequence number, and the Heap is
+ * keyed by (time, sequence). When timetype is an integral type of
+ * at most 32 bits, both are packed into one uint64_t key, time in
+ * the high half (biased, so signed times keep their order) and
+ * sequence in the low half, which halves the memory the keys take.
+ * Any other timetype (64 bit, floating point, ...) uses a
+ * WideEventKey holding the time and a 64 bit sequence. Draining a
+ * large scheduler is bound by the Heap's cache misses, and packing
+ * has not measured faster than WideEventKey there.
+ *
+ * Sequence numbers restart whenever the scheduler is empty, so a
+ * packed scheduler only runs out if 2^32 events are scheduled
+ * without it ever draining. scheduleAt then throws
+ * std::overflow_error.
+ *
+ * runUntil(t, fn) calls fn(time, event) for every event due at or
+ * before t, in order. It works a batch at a time: all events due at
+ * the earliest time are taken out of the Heap together, then fired.
+ * fn may schedule and cancel events, including ones in the batch
+ * being fired, but must not call runUntil itself. If fn throws,
+ * the events of the batch that had not fired are put back.
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef EVENT_SCHEDULER_CPP
+#define EVENT_SCHEDULER_CPP
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "CDA.cpp"
+#include "Heap.cpp"
+
+
+// WideEventKey orders events by time, then by sequence number
+template <typename timetype>
+struct WideEventKey {
+    timetype time;
+    std::uint64_t seq;
+    WideEventKey() : time(), seq(0) {}
+    WideEventKey(timetype time, std::uint64_t seq) : time(time), seq(seq) {}
+    bool operator<(WideEventKey const &rhs) const { return time < rhs.time || (!(rhs.time < time) && seq < rhs.seq); }
+    bool operator>(WideEventKey const &rhs) const { return rhs < *this; }
+};
+
+
+// EventScheduler fires events in time order, and in scheduling order within a time
+template <typename timetype, typename eventtype>
+class EventScheduler {
+    static const bool kPacked = std::is_integral<timetype>::value && sizeof(timetype) <= 4;
+    using keytype = typename std::conditional<kPacked, std::uint64_t, WideEventKey<timetype>>::type;
+
+public:
+    // Identifies one scheduled event. A handle never matches a later event.
+    struct Handle {
+        int slot;                                   // Heap handle of the event
+        std::uint64_t seq;                          // Sequence number of the event
+        std::uint64_t epoch;                        // Which run of sequence numbers seq belongs to
+    };
+
+    EventScheduler();
+
+    Handle scheduleAt(timetype t, eventtype e);     // Queue event e to fire at time t
+    bool cancel(Handle h);                          // Remove a pending event, false if it already fired or was cancelled
+    template <typename Callback>
+    long long runUntil(timetype t, Callback fn);    // Fire every event due at or before t, returns how many fired
+    timetype nextTime();                            // Time of the earliest pending event
+    int size();                                     // Number of pending events
+
+private:
+    // An event taken out of the Heap by runUntil, waiting for its turn.
+    struct BatchEntry {
+        std::uint64_t seq;
+        eventtype event;
+        bool cancelled;
+        bool operator<(BatchEntry const &rhs) const { return seq < rhs.seq; }
+        bool operator>(BatchEntry const &rhs) const { return seq > rhs.seq; }
+    };
+
+    static keytype makeKey(timetype t, std::uint64_t seq);
+    static timetype timeOf(const keytype &key);
+    static std::uint64_t seqOf(const keytype &key);
+
+    Heap<keytype, eventtype> heap_;
+    CDA<BatchEntry, UncheckedIndex> batch_;         // The batch runUntil is firing, in sequence order
+    timetype batch_time_;
+    int batch_next_;                                // Index in batch_ of the next entry to fire
+    int batch_pending_;                             // Entries of batch_ not yet fired or cancelled
+    std::uint64_t next_seq_;
+    std::uint64_t epoch_;
+};
+
+
+template <typename timetype, typename eventtype>
+EventScheduler<timetype, eventtype>::EventScheduler() {
+    batch_time_ = timetype();
+    batch_next_ = 0;
+    batch_pending_ = 0;
+    next_seq_ = 0;
+    epoch_ = 0;
+}
+
+
+template <typename timetype, typename eventtype>
+typename EventScheduler<timetype, eventtype>::Handle EventScheduler<timetype, eventtype>::scheduleAt(timetype t, eventtype e) {
+    if (heap_.size() == 0 && batch_.Length() == 0) {
+        // Nothing pending can compare against a new sequence number, so
+        // restart them. The epoch keeps old handles from matching new events.
+        next_seq_ = 0;
+        epoch_++;
+    }
+    std::uint64_t seq_limit = kPacked ? (std::uint64_t(1) << 32) : std::numeric_limits<std::uint64_t>::max();
+    if (next_seq_ == seq_limit) {
+        throw std::overflow_error("EventScheduler ran out of sequence numbers without draining");
+    }
+    Handle handle;
+    handle.seq = next_seq_++;
+    handle.epoch = epoch_;
+    handle.slot = heap_.insert(makeKey(t, handle.seq), std::move(e));
+    return handle;
+}
+
+
+template <typename timetype, typename eventtype>
+bool EventScheduler<timetype, eventtype>::cancel(Handle h) {
+    if (h.epoch != epoch_) {
+        return false;
+    }
+    // The Heap reuses slots, so the sequence number must match too.
+    if (heap_.contains(h.slot) && seqOf(heap_.keyOf(h.slot)) == h.seq) {
+        heap_.erase(h.slot);
+        return true;
+    }
+
+    // The event may be in the batch being fired, which is sorted by sequence.
+    int low = batch_next_;
+    int high = batch_.Length() - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (batch_[middle].seq == h.seq) {
+            if (batch_[middle].cancelled) {
+                return false;
+            }
+            batch_[middle].cancelled = true;
+            batch_pending_--;
+            return true;
+        }
+        if (batch_[middle].seq < h.seq) {
+            low = middle + 1;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+    return false;
+}
+
+
+template <typename timetype, typename eventtype>
+template <typename Callback>
+long long EventScheduler<timetype, eventtype>::runUntil(timetype t, Callback fn) {
+    long long fired = 0;
+    while (heap_.size() > 0 && !(t < timeOf(heap_.peekKey()))) {
+        // Take every event due at the earliest time out in one go. They
+        // come out in key order, which is sequence order.
+        batch_time_ = timeOf(heap_.peekKey());
+        while (heap_.size() > 0 && !(batch_time_ < timeOf(heap_.peekKey()))) {
+            BatchEntry entry;
+            entry.seq = seqOf(heap_.extractMin(entry.event));
+            entry.cancelled = false;
+            batch_.AddEnd(std::move(entry));
+        }
+        batch_next_ = 0;
+        batch_pending_ = batch_.Length();
+
+        try {
+            while (batch_next_ < batch_.Length()) {
+                BatchEntry &entry = batch_[batch_next_];
+                batch_next_++;
+                if (!entry.cancelled) {
+                    batch_pending_--;
+                    fired++;
+                    fn(batch_time_, entry.event);
+                }
+            }
+        }
+        catch (...) {
+            // Put the unfired events back, under their old keys so they keep
+            // their place. Handles to them become stale.
+            for (int i = batch_next_; i < batch_.Length(); i++) {
+                if (!batch_[i].cancelled) {
+                    heap_.insert(makeKey(batch_time_, batch_[i].seq), std::move(batch_[i].event));
+                }
+            }
+            batch_.DelEnd(batch_.Length());
+            batch_next_ = 0;
+            batch_pending_ = 0;
+            throw;
+        }
+        batch_.DelEnd(batch_.Length());
+        batch_next_ = 0;
+        batch_pending_ = 0;
+    }
+    return fired;
+}
+
+
+template <typename timetype, typename eventtype>
+timetype EventScheduler<timetype, eventtype>::nextTime() {
+    if (batch_pending_ > 0) {
+        return batch_time_;
+    }
+    if (heap_.size() == 0) {
+        throw std::out_of_range("EventScheduler::nextTime with no pending events");
+    }
+    return timeOf(heap_.peekKey());
+}
+
+
+template <typename timetype, typename eventtype>
+int EventScheduler<timetype, eventtype>::size() {
+    return heap_.size() + batch_pending_;
+}
+
+
+template <typename timetype, typename eventtype>
+typename EventScheduler<timetype, eventtype>::keytype EventScheduler<timetype, eventtype>::makeKey(timetype t, std::uint64_t seq) {
+    if constexpr (kPacked) {
+        // Bias by the smallest time, so the unsigned word sorts like timetype.
+        std::uint64_t biased = (std::uint64_t)((std::int64_t)t - (std::int64_t)std::numeric_limits<timetype>::min());
+        return (biased << 32) | seq;
+    }
+    else {
+        return WideEventKey<timetype>(t, seq);
+    }
+}
+
+
+template <typename timetype, typename eventtype>
+timetype EventScheduler<timetype, eventtype>::timeOf(const keytype &key) {
+    if constexpr (kPacked) {
+        return (timetype)((std::int64_t)(key >> 32) + (std::int64_t)std::numeric_limits<timetype>::min());
+    }
+    else {
+        return key.time;
+    }
+}
+
+
+template <typename timetype, typename eventtype>
+std::uint64_t EventScheduler<timetype, eventtype>::seqOf(const keytype &key) {
+    if constexpr (kPacked) {
+        return key & 0xffffffffULL;
+    }
+    else {
+        return key.seq;
+    }
+}
+
+
+#endif
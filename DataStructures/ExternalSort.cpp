@@ -0,0 +1,367 @@
+/*
+ * Implementation of an External Merge Sort.
+ *
+ * This file contains two classes:
+ * 1. RunReader
+ * 2. ExternalSorter
+ *
+ * ExternalSorter<T> sorts a binary file of fixed size T records
+ * that may be much larger than memory. It works in two phases:
+ *
+ * 1. Run formation. Records are read into a CDA holding at most
+ *    memory_bytes worth of records, sorted in memory with
+ *    QuickSort, and spilled to an anonymous temporary file.
+ * 2. Merging. The sorted runs are k-way merged, using a
+ *    Heap<T, int> keyed by each run's current record (with the
+ *    run index as the value) as the merge tournament. Each run is
+ *    read through its own buffer of block records, so reads are
+ *    large sequential transfers instead of one fread per record.
+ *    When there are more runs than the fan-in allows, groups of
+ *    runs are merged into longer runs first (multi-pass merging).
+ *
+ * T must be trivially copyable and comparable with < and >.
+ * I/O errors are reported by throwing std::runtime_error.
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef EXTERNAL_SORT_CPP
+#define EXTERNAL_SORT_CPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unistd.h>
+#include "CDA.cpp"
+#include "Heap.cpp"
+
+
+// RunReader streams the records of one sorted run through a fixed size buffer
+template <typename T>
+class RunReader {
+public:
+    RunReader(std::FILE* file, int block_records);
+    RunReader(const RunReader &) = delete;
+    RunReader& operator=(const RunReader &) = delete;
+
+    bool next(T &record);                                   // Read the next record, false once the run is exhausted.
+    ~RunReader();
+
+private:
+    std::FILE* file_;
+    T* buffer_;                                             // Read-ahead buffer of block_records_ records.
+    int block_records_;
+    int filled_;                                            // Number of valid records in buffer_.
+    int position_;                                          // Index of the next record to hand out.
+};
+
+
+template <typename T>
+RunReader<T>::RunReader(std::FILE* file, int block_records) {
+    file_ = file;
+    block_records_ = block_records;
+    buffer_ = new T[block_records_];
+    filled_ = 0;
+    position_ = 0;
+    std::rewind(file_);
+}
+
+
+template <typename T>
+bool RunReader<T>::next(T &record) {
+    if (position_ == filled_) {
+        filled_ = (int)std::fread(buffer_, sizeof(T), block_records_, file_);
+        position_ = 0;
+        if (filled_ == 0) {
+            if (std::ferror(file_)) {
+                throw std::runtime_error("ExternalSorter: failed to read a run");
+            }
+            return false;
+        }
+    }
+    record = buffer_[position_++];
+    return true;
+}
+
+
+template <typename T>
+RunReader<T>::~RunReader() {
+    delete[] buffer_;
+}
+
+
+// ExternalSorter sorts files of T records using a bounded amount of memory
+template <typename T>
+class ExternalSorter {
+    static_assert(std::is_trivially_copyable<T>::value, "ExternalSorter records are written to disk byte for byte");
+
+public:
+    ExternalSorter(long long memory_bytes, std::string temp_dir = "/tmp", int max_fan_in = 64);
+
+    long long sort(const std::string &input_path, const std::string &output_path);   // Sort a file, returns the number of records.
+    long long sort(std::FILE* input, std::FILE* output);                             // Sort an open stream into another.
+    int runsCreated();                                      // Number of runs spilled by the last sort.
+    int mergePasses();                                      // Number of merge passes made by the last sort.
+
+private:
+    std::FILE* createTempFile();                            // An anonymous read/write file in temp_dir_.
+    long long createRuns(std::FILE* input, CDA<std::FILE*> &runs);
+    void mergeRuns(CDA<std::FILE*> &runs, int first, int count, std::FILE* output);
+    void writeRecords(std::FILE* output, T* records, int count);
+
+    long long memory_bytes_;                                // Total memory budget for records and I/O buffers.
+    std::string temp_dir_;
+    int max_fan_in_;                                        // Most runs merged at once.
+    int runs_created_;
+    int merge_passes_;
+};
+
+
+template <typename T>
+ExternalSorter<T>::ExternalSorter(long long memory_bytes, std::string temp_dir, int max_fan_in) {
+    memory_bytes_ = memory_bytes;
+    temp_dir_ = temp_dir;
+    max_fan_in_ = (max_fan_in < 2) ? 2 : max_fan_in;
+    runs_created_ = 0;
+    merge_passes_ = 0;
+}
+
+
+template <typename T>
+long long ExternalSorter<T>::sort(const std::string &input_path, const std::string &output_path) {
+    std::FILE* input = std::fopen(input_path.c_str(), "rb");
+    if (input == nullptr) {
+        throw std::runtime_error("ExternalSorter: cannot open " + input_path);
+    }
+    std::FILE* output = std::fopen(output_path.c_str(), "wb");
+    if (output == nullptr) {
+        std::fclose(input);
+        throw std::runtime_error("ExternalSorter: cannot create " + output_path);
+    }
+    long long records;
+    try {
+        records = sort(input, output);
+    }
+    catch (...) {
+        std::fclose(input);
+        std::fclose(output);
+        throw;
+    }
+    std::fclose(input);
+    if (std::fclose(output) != 0) {
+        throw std::runtime_error("ExternalSorter: failed to write " + output_path);
+    }
+    return records;
+}
+
+
+template <typename T>
+long long ExternalSorter<T>::sort(std::FILE* input, std::FILE* output) {
+    CDA<std::FILE*> runs;
+    runs_created_ = 0;
+    merge_passes_ = 0;
+    long long records;
+    try {
+        records = createRuns(input, runs);
+        runs_created_ = runs.Length();
+
+        // Merge groups of runs into longer runs until one pass can finish the job.
+        int first = 0;
+        while (runs.Length() - first > max_fan_in_) {
+            int pass_end = runs.Length();
+            while (first < pass_end) {
+                int count = (pass_end - first < max_fan_in_) ? pass_end - first : max_fan_in_;
+                std::FILE* merged = createTempFile();
+                runs.AddEnd(merged);
+                mergeRuns(runs, first, count, merged);
+                first += count;
+            }
+            merge_passes_++;
+        }
+        mergeRuns(runs, first, runs.Length() - first, output);
+        merge_passes_++;
+    }
+    catch (...) {
+        for (int i = 0; i < runs.Length(); i++) {
+            if (runs[i] != nullptr) {
+                std::fclose(runs[i]);
+            }
+        }
+        throw;
+    }
+    if (std::fflush(output) != 0) {
+        throw std::runtime_error("ExternalSorter: failed to write the output");
+    }
+    return records;
+}
+
+
+template <typename T>
+int ExternalSorter<T>::runsCreated() {
+    return runs_created_;
+}
+
+
+template <typename T>
+int ExternalSorter<T>::mergePasses() {
+    return merge_passes_;
+}
+
+
+template <typename T>
+std::FILE* ExternalSorter<T>::createTempFile() {
+    std::string pattern = temp_dir_ + "/extsort-XXXXXX";
+    int fd = mkstemp(&pattern[0]);
+    if (fd < 0) {
+        throw std::runtime_error("ExternalSorter: cannot create a temporary file in " + temp_dir_);
+    }
+    // Unlink right away, so the run disappears when it is closed or the process dies.
+    unlink(pattern.c_str());
+    std::FILE* file = fdopen(fd, "w+b");
+    if (file == nullptr) {
+        close(fd);
+        throw std::runtime_error("ExternalSorter: cannot open a temporary file");
+    }
+    return file;
+}
+
+
+template <typename T>
+long long ExternalSorter<T>::createRuns(std::FILE* input, CDA<std::FILE*> &runs) {
+    long long run_records = memory_bytes_ / (long long)sizeof(T);
+    if (run_records < 1) {
+        run_records = 1;
+    }
+    if (run_records > 0x3fffffff) {
+        run_records = 0x3fffffff;
+    }
+
+    // The run is allocated once at full size and refilled for every run.
+    CDA<T, UncheckedIndex> run((int)run_records);
+    const int staging_records = 4096;
+    T* staging = new T[staging_records];
+    long long total = 0;
+
+    try {
+        while (true) {
+            int filled = 0;
+            while (filled < run_records) {
+                int want = (run_records - filled < staging_records) ? (int)(run_records - filled) : staging_records;
+                int got = (int)std::fread(staging, sizeof(T), want, input);
+                for (int i = 0; i < got; i++) {
+                    run[filled + i] = staging[i];
+                }
+                filled += got;
+                if (got < want) {
+                    if (std::ferror(input)) {
+                        throw std::runtime_error("ExternalSorter: failed to read the input");
+                    }
+                    break;
+                }
+            }
+            if (filled == 0) {
+                break;
+            }
+
+            run.QuickSortReal(0, filled - 1);
+            std::FILE* file = createTempFile();
+            runs.AddEnd(file);
+            for (int i = 0; i < filled; i += staging_records) {
+                int count = (filled - i < staging_records) ? filled - i : staging_records;
+                for (int j = 0; j < count; j++) {
+                    staging[j] = run[i + j];
+                }
+                writeRecords(file, staging, count);
+            }
+            total += filled;
+            if (filled < run_records) {
+                break;
+            }
+        }
+    }
+    catch (...) {
+        delete[] staging;
+        throw;
+    }
+    delete[] staging;
+    return total;
+}
+
+
+template <typename T>
+void ExternalSorter<T>::mergeRuns(CDA<std::FILE*> &runs, int first, int count, std::FILE* output) {
+    // Split the memory budget between one read buffer per run and the output buffer.
+    long long block_records = memory_bytes_ / ((long long)(count + 1) * (long long)sizeof(T));
+    if (block_records < 1) {
+        block_records = 1;
+    }
+    if (block_records > (1 << 20)) {
+        block_records = 1 << 20;
+    }
+
+    CDA<RunReader<T>*, UncheckedIndex> readers;
+    T* out_buffer = new T[block_records];
+    int out_filled = 0;
+    Heap<T, int> tournament;
+
+    try {
+        for (int i = 0; i < count; i++) {
+            readers.AddEnd(new RunReader<T>(runs[first + i], (int)block_records));
+        }
+        for (int i = 0; i < count; i++) {
+            T record;
+            if (readers[i]->next(record)) {
+                tournament.insert(record, i);
+            }
+        }
+
+        // The winner of the tournament is the smallest unmerged record. Its
+        // run supplies the next challenger.
+        while (tournament.size() > 0) {
+            int run_index = tournament.peekValue();
+            out_buffer[out_filled++] = tournament.extractMin();
+            if (out_filled == block_records) {
+                writeRecords(output, out_buffer, out_filled);
+                out_filled = 0;
+            }
+            T record;
+            if (readers[run_index]->next(record)) {
+                tournament.insert(record, run_index);
+            }
+        }
+        writeRecords(output, out_buffer, out_filled);
+    }
+    catch (...) {
+        for (int i = 0; i < readers.Length(); i++) {
+            delete readers[i];
+        }
+        delete[] out_buffer;
+        throw;
+    }
+
+    for (int i = 0; i < readers.Length(); i++) {
+        delete readers[i];
+    }
+    delete[] out_buffer;
+
+    // The merged runs are no longer needed, closing them frees their space.
+    for (int i = 0; i < count; i++) {
+        std::fclose(runs[first + i]);
+        runs[first + i] = nullptr;
+    }
+}
+
+
+template <typename T>
+void ExternalSorter<T>::writeRecords(std::FILE* output, T* records, int count) {
+    if (count > 0 && std::fwrite(records, sizeof(T), count, output) != (size_t)count) {
+        throw std::runtime_error("ExternalSorter: failed to write records");
+    }
+}
+
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Implementation of a Fixed Capacity Circular Array
+ *
+ * This file contains one class:
+ * 1. FixedCDA
+ *
+ * This class is templated, and takes a typename T and
+ * a capacity N. It has the same method surface as CDA,
+ * but its storage is an inline array of N elements and
+ * every method is constexpr, so a FixedCDA can be filled,
+ * sorted and searched entirely at compile time:
+ *
+ *    constexpr auto table = [] {
+ *        FixedCDA<int, 4> t;
+ *        t.AddEnd(3); t.AddEnd(1); t.AddEnd(4); t.AddEnd(2);
+ *        t.QuickSort();
+ *        return t;
+ *    }();
+ *    static_assert(table.Search(3) == 2);
+ *
+ * T must be a literal type that is default constructible.
+ * Adding to a full FixedCDA or indexing out of bounds throws,
+ * which is a compile error when it happens in a constant
+ * expression. Sorting, selection and searching share their
+ * code with CDA (see CDAAlgorithms.cpp). Select uses a median
+ * of three pivot instead of rand(), which is not constexpr.
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef FIXED_CDA_CPP
+#define FIXED_CDA_CPP
+
+#include <stdexcept>
+#include "CDAAlgorithms.cpp"
+
+// FixedCDA is a Circular Array with a compile-time capacity of N
+template <typename T, int N>
+class FixedCDA {
+    static_assert(N > 0, "FixedCDA needs a capacity of at least one element");
+
+    public:
+
+        constexpr FixedCDA() : my_array_(), length_(0), front_(0), is_ordered_(false) {}
+
+        constexpr T& operator[](int index) { return at(index); }                 // Bounds checked access.
+        constexpr const T& operator[](int index) const { return at(index); }     // Bounds checked access.
+        constexpr T& at(int index);                             // Bounds checked access, throws std::out_of_range.
+        constexpr const T& at(int index) const;                 // Bounds checked access, throws std::out_of_range.
+
+        constexpr void AddEnd(T v);                             // Add an element v to the end, throws std::length_error when full.
+        constexpr void AddFront(T v);                           // Add an element v to the front, throws std::length_error when full.
+        constexpr void DelEnd();                                // Delete the element at the end.
+        constexpr void DelFront();                              // Delete the element at the front.
+
+        constexpr int Length() const { return length_; }        // Return the number of elements.
+        constexpr int Capacity() const { return N; }            // Return the fixed capacity N.
+        constexpr void Clear();                                 // Clear all of the elements.
+        constexpr bool Ordered() const { return is_ordered_; }  // Returns true if known to be ordered.
+        constexpr int SetOrdered();                             // Check if ordered, and assign is_ordered_ accordingly.
+
+        constexpr T Select(int k);                              // Return the kth smallest element.
+        constexpr T QuickSelect(int k);                         // Find the kth smallest element with QuickSelect.
+        constexpr void QuickSort();                             // Sort using Quick Sort (Switches to Insertion Sort).
+        constexpr void InsertionSort();                         // Sort using Insertion Sort.
+        constexpr int Search(T e) const;                        // Returns the index of the element e, or -1.
+
+    private:
+
+        T my_array_[N];                                         // Inline storage, no dynamic allocation.
+        int length_;                                            // The number of elements in the FixedCDA.
+        int front_;                                             // The index of the "first" item of the array.
+        bool is_ordered_;                                       // A flag representing whether the FixedCDA is sorted.
+};
+
+
+template <typename T, int N>
+constexpr T& FixedCDA<T, N>::at(int index) {
+    if (index < 0 || index > length_ - 1) {
+        throw std::out_of_range("FixedCDA::at index is out of bounds");
+    }
+    return my_array_[(front_ + index) % N];
+}
+
+
+template <typename T, int N>
+constexpr const T& FixedCDA<T, N>::at(int index) const {
+    if (index < 0 || index > length_ - 1) {
+        throw std::out_of_range("FixedCDA::at index is out of bounds");
+    }
+    return my_array_[(front_ + index) % N];
+}
+
+
+template <typename T, int N>
+constexpr void FixedCDA<T, N>::AddEnd(T v) {
+    if (length_ == N) {
+        throw std::length_error("FixedCDA is full");
+    }
+    if (is_ordered_ && length_ > 0 && my_array_[(front_ + length_ - 1) % N] > v) {
+        is_ordered_ = false;
+    }
+    my_array_[(front_ + length_) % N] = v;
+    length_++;
+}
+
+
+template <typename T, int N>
+constexpr void FixedCDA<T, N>::AddFront(T v) {
+    if (length_ == N) {
+        throw std::length_error("FixedCDA is full");
+    }
+    if (is_ordered_ && length_ > 0 && my_array_[front_] < v) {
+        is_ordered_ = false;
+    }
+    front_ = (front_ == 0) ? N - 1 : front_ - 1;
+    my_array_[front_] = v;
+    length_++;
+}
+
+
+template <typename T, int N>
+constexpr void FixedCDA<T, N>::DelEnd() {
+    if (length_ > 0) {
+        length_--;
+    }
+}
+
+
+template <typename T, int N>
+constexpr void FixedCDA<T, N>::DelFront() {
+    if (length_ > 0) {
+        front_ = (front_ + 1) % N;
+        length_--;
+    }
+}
+
+
+template <typename T, int N>
+constexpr void FixedCDA<T, N>::Clear() {
+    length_ = 0;
+    front_ = 0;
+    is_ordered_ = false;
+}
+
+
+template <typename T, int N>
+constexpr int FixedCDA<T, N>::SetOrdered() {
+    is_ordered_ = RingIsOrdered(my_array_, front_, N, length_);
+    return is_ordered_ ? 1 : -1;
+}
+
+
+template <typename T, int N>
+constexpr T FixedCDA<T, N>::Select(int k) {
+    if (SetOrdered() == 1) {
+        return at(k - 1);
+    }
+    return QuickSelect(k);
+}
+
+
+template <typename T, int N>
+constexpr T FixedCDA<T, N>::QuickSelect(int k) {
+    if (k < 1 || k > length_) {
+        throw std::out_of_range("FixedCDA::QuickSelect k is out of range");
+    }
+    NoCDAStats stats;
+    int front = front_;
+    T* data = my_array_;
+    auto median_pivot = [data, front](int low, int high) {
+        int mid = low + (high - low) / 2;
+        T median = MedianOfThree(RingAt(data, front, N, low), RingAt(data, front, N, mid), RingAt(data, front, N, high));
+        if (median == RingAt(data, front, N, low)) {
+            return low;
+        }
+        return (median == RingAt(data, front, N, mid)) ? mid : high;
+    };
+    return RingQuickSelect(my_array_, front_, N, 0, length_ - 1, k - 1, median_pivot, stats);
+}
+
+
+template <typename T, int N>
+constexpr void FixedCDA<T, N>::QuickSort() {
+    NoCDAStats stats;
+    RingQuickSort(my_array_, front_, N, 0, length_ - 1, stats);
+    is_ordered_ = true;
+}
+
+
+template <typename T, int N>
+constexpr void FixedCDA<T, N>::InsertionSort() {
+    NoCDAStats stats;
+    RingInsertionSort(my_array_, front_, N, 0, length_ - 1, stats);
+    is_ordered_ = true;
+}
+
+
+template <typename T, int N>
+constexpr int FixedCDA<T, N>::Search(T e) const {
+    if (is_ordered_) {
+        return RingBinarySearch(my_array_, front_, N, e, 0, length_ - 1);
+    }
+    return RingLinearSearch(my_array_, front_, N, e, length_);
+}
+
+
+#endif
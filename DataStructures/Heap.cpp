@@ -1,5 +1,5 @@
 /*
- * Implementation of a Binary Heap.
+ * Implementation of a d-ary Heap.
  * 
  * This file contains two classes:
  * 1. Heap
@@ -7,12 +7,53 @@
  * 
  * Both of these classes are templated, with
  * two typenames: keytype and valuetype.
- * Therefore, any instantiation of BNode or
- * BHeap must be as follows:
+ * Heap also takes an optional Arity, the number
+ * of children per node, which defaults to 2.
+ * Therefore, any instantiation of Node or
+ * Heap must be as follows:
  * 1. template <typename keytype, typename keytype>
  *    Node<keytype, valuetype> this_name;
  * 2. template <typename keytype, typename valuetype>
  *    Heap<keytype, valuetype> that_name;
+ *    Heap<keytype, valuetype, 4> quaternary_heap;
+ * 
+ * The children of node i are Arity * i + 1 through
+ * Arity * i + Arity. The root is stored Arity - 1 slots
+ * into the (cache line aligned) CDA, which puts every group
+ * of siblings at a slot that is a multiple of Arity. Sifts
+ * only read the keys, so when Arity * sizeof(keytype) is 64
+ * (e.g. 16-ary with int keys, 8-ary with 8 byte keys) each
+ * sibling group is exactly one cache line, and a siftDown
+ * level costs one miss.
+ * 
+ * Peeking at or extracting from an empty Heap throws
+ * std::out_of_range.
+ * 
+ * insert returns a handle for the new element, which
+ * stays valid while the element is in the Heap, no matter
+ * how it moves. decreaseKey, increaseKey and erase take a
+ * handle and run in O(log n). Once an element has been
+ * extracted or erased, its handle may be reused by a later
+ * insert.
+ * 
+ * insertMany adds a whole batch at once (moving the keys
+ * and values out of the caller's spans) and then either
+ * sifts each new element up or re-heapifies only the
+ * subtrees above the batch, whichever is estimated to need
+ * fewer comparisons. It requires C++20 for std::span.
+ * 
+ * extractMinBatch removes the k smallest elements at once
+ * and hands them back as (key, value) Nodes in order. The k
+ * smallest form a connected top part of the tree, which is
+ * found with a small candidate heap in O(k log k) before the
+ * Heap itself is repaired in a single pass.
+ * 
+ * Copying a Heap is O(1): its arrays are copy-on-write CDAs,
+ * so a copy shares them until either Heap is modified, and
+ * only then are the arrays it writes to duplicated. A
+ * snapshot taken while the Heap is not being modified can be
+ * read through its const methods (peekKey, peekValue, size,
+ * contains, keyOf) on another thread without copying anything.
  * 
  * 
  * @author      Stephen Gregory
@@ -23,6 +64,13 @@
 #define HEAP_CPP
 
 #include <iostream>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#if defined(__SSE__)
+#include <immintrin.h>
+#endif
 #include "CDA.cpp"
 
 // Node is one single element of a CDA
@@ -31,7 +79,7 @@ struct Node {
     keytype key;
     valuetype value;
     Node() {}
-    Node(keytype key, valuetype value) : key(key), value(value) {}
+    Node(keytype key, valuetype value) : key(std::move(key)), value(std::move(value)) {}
     bool operator<(Node const &rhs) { return key < rhs.key; };
     bool operator<=(Node const &rhs) { return key <= rhs.key; };
     bool operator==(Node const &rhs) { return key == rhs.key; };
@@ -40,183 +88,671 @@ struct Node {
 };
 
 
-// Heap is a Binary Min-Ordered Heap
-template <typename keytype, typename valuetype>
+// HeapMinKeyIndex returns the position of the first smallest of keys[0..count-1].
+// Generic keys are compared one at a time. Arithmetic keys use a branchless
+// loop, and full groups of 4 or 8 int or float keys are reduced with SSE.
+template <typename keytype>
+inline int HeapMinKeyIndex(const keytype* keys, int count) {
+    int min_index = 0;
+    if constexpr (std::is_arithmetic<keytype>::value) {
+        for (int i = 1; i < count; i++) {
+            min_index = (keys[i] < keys[min_index]) ? i : min_index;
+        }
+    }
+    else {
+        for (int i = 1; i < count; i++) {
+            if (keys[i] < keys[min_index]) {
+                min_index = i;
+            }
+        }
+    }
+    return min_index;
+}
+
+
+#if defined(__SSE4_1__)
+inline int HeapMinKeyIndex(const int* keys, int count) {
+    if (count != 4 && count != 8) {
+        return HeapMinKeyIndex<int>(keys, count);
+    }
+    __m128i low = _mm_loadu_si128((const __m128i*)keys);
+    __m128i high = (count == 8) ? _mm_loadu_si128((const __m128i*)(keys + 4)) : low;
+    __m128i min = _mm_min_epi32(low, high);
+    min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(1, 0, 3, 2)));
+    min = _mm_min_epi32(min, _mm_shuffle_epi32(min, _MM_SHUFFLE(2, 3, 0, 1)));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(low, min)));
+    if (count == 8) {
+        mask |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(high, min))) << 4;
+    }
+    return __builtin_ctz(mask);
+}
+#endif
+
+
+#if defined(__SSE__)
+// Float keys must not be NaN, which has no place in a min-ordering anyway.
+inline int HeapMinKeyIndex(const float* keys, int count) {
+    if (count != 4 && count != 8) {
+        return HeapMinKeyIndex<float>(keys, count);
+    }
+    __m128 low = _mm_loadu_ps(keys);
+    __m128 high = (count == 8) ? _mm_loadu_ps(keys + 4) : low;
+    __m128 min = _mm_min_ps(low, high);
+    min = _mm_min_ps(min, _mm_shuffle_ps(min, min, _MM_SHUFFLE(1, 0, 3, 2)));
+    min = _mm_min_ps(min, _mm_shuffle_ps(min, min, _MM_SHUFFLE(2, 3, 0, 1)));
+    int mask = _mm_movemask_ps(_mm_cmpeq_ps(low, min));
+    if (count == 8) {
+        mask |= _mm_movemask_ps(_mm_cmpeq_ps(high, min)) << 4;
+    }
+    return __builtin_ctz(mask);
+}
+#endif
+
+
+// Heap is a d-ary Min-Ordered Heap
+template <typename keytype, typename valuetype, int Arity = 2>
 class Heap {
+    static_assert(Arity >= 2, "A Heap node needs at least two children");
+
 public:
     Heap();                                         // Default Constructor for empty Heap 
     Heap(keytype k[], valuetype v[], int s);        // Constructor with keys k[], values v[], size s
     Heap(const Heap &heap);                         // Copy Constructor
     Heap& operator=(const Heap &heap);              // Copy assignment operator
 
-    void insert(keytype k, valuetype v);            // Inserts key k and value v into the Heap
+    int insert(keytype k, valuetype v);             // Inserts key k and value v into the Heap, returns its handle
+    void insertMany(std::span<keytype> keys, std::span<valuetype> values, std::span<int> handles = {});
+                                                    // Moves keys[i] and values[i] into the Heap, handles[i] gets each handle
+    void insertMany(keytype k[], valuetype v[], int s);
+                                                    // Inserts keys k[] and values v[] of size s
+    void decreaseKey(int handle, keytype k);        // Lower the key of the element with the given handle to k
+    void increaseKey(int handle, keytype k);        // Raise the key of the element with the given handle to k
+    void erase(int handle);                         // Remove the element with the given handle
+    bool contains(int handle) const;                // True if handle refers to an element in the Heap
+    keytype keyOf(int handle) const;                // The key of the element with the given handle
     void siftUp(int node_index);                    // Sift up heap violating node
     void siftDown(int node_index);                  // Sifts down heap violating node
-    void printKey();                                // Writes the keys in array, starting at root
-    keytype peekKey();                              // Return min key without modifying the Heap
-    valuetype peekValue();                          // Return min value without modifying the Heap
+    void printKey() const;                          // Writes the keys in array, starting at root
+    keytype peekKey() const;                        // Return min key without modifying the Heap
+    valuetype peekValue() const;                    // Return min value without modifying the Heap
+    int size() const;                               // Return the number of elements in the Heap
     keytype extractMin();                           // Removes the min key in the Heap and returns the key.
+    keytype extractMin(valuetype &value);           // extractMin, moving the min value into value
+    int replaceMin(keytype k, valuetype v);         // extractMin then insert in one sift, returns the new handle
+    void extractMinBatch(int k, CDA<Node<keytype, valuetype>> &out);
+                                                    // Removes the k smallest, appending them to out in order
     int getParentIndex(int node_index);             // Find the parent of a given Node
-    int getLeftChildIndex(int node_index);          // Find the left child of a given Node
-    int getRightChildIndex(int node_index);         // Find the right of a given Node
+    int getLeftChildIndex(int node_index);          // Find the first (leftmost) child of a given Node
+    int getRightChildIndex(int node_index);         // Find the last (rightmost) child of a given Node
     ~Heap();                                        // Destructor
 
 private:
-    CDA<Node<keytype, valuetype>> my_array_;        // Array of elements in min heap
+    static const int kRootOffset = Arity - 1;       // Unused slots in front of the root, aligns sibling groups
+    keytype& key(int node_index);                   // The key at heap index node_index
+    const keytype& key(int node_index) const;       // The key at heap index node_index, without unsharing keys_
+    int slot(int node_index) const;                 // The value slot (handle) of heap index node_index
+    void place(int node_index, keytype k, int value_slot);
+                                                    // Put key k and its slot at node_index, updating positions_
+    void removeAt(int node_index);                  // Remove the element at node_index
+    int minChildIndex(int first_child_index);       // The smallest of the siblings starting at first_child_index
+    void siftDownBottomUp(int node_index);          // siftDown for a key that likely belongs near the leaves
+    bool batchHeapifyIsCheaper(int old_size);       // Whether heapifyFrom(old_size) beats sifting each new element up
+    void heapifyFrom(int old_size);                 // Restore heap order after appending elements old_size and up
+    int allocateSlot(valuetype v);                  // Store v in a free value slot and return the slot
+    void releaseSlot(int value_slot);               // Return a value slot to the free list
+
+    CDA<keytype, UncheckedIndex> keys_;             // Keys in heap order, the only array sifts compare
+    CDA<int, UncheckedIndex> slots_;                // slots_[i] is the value slot of keys_[i]
+    CDA<valuetype, UncheckedIndex> values_;         // Values, indexed by slot, never moved by a sift
+    CDA<int, UncheckedIndex> positions_;            // positions_[s] is the heap index of slot s, or -1
+    CDA<int, UncheckedIndex> free_slots_;           // Slots of values_ that can be reused
     int heap_size_;                                 // Current number of elements in min heap
 };
 
 
-template <typename keytype, typename valuetype>
-Heap<keytype,valuetype>::Heap(keytype k[], valuetype v[], int s) {
+template <typename keytype, typename valuetype, int Arity>
+Heap<keytype, valuetype, Arity>::Heap(keytype k[], valuetype v[], int s) {
+    for (int i = 0; i < kRootOffset; i++) {
+        keys_.AddEnd(keytype());
+        slots_.AddEnd(-1);
+    }
     for (int i = 0; i < s; i++) {
-        Node<keytype, valuetype> new_node(k[i], v[i]);
-        my_array_.AddEnd(new_node);
+        keys_.AddEnd(k[i]);
+        slots_.AddEnd(i);
+        values_.AddEnd(v[i]);
+        positions_.AddEnd(i);
     }
     heap_size_ = s;
-    for (int i = ((heap_size_ / 2) - 1); i >= 0; i--) {
-        siftDown(i);
+    if (heap_size_ > 1) {
+        heapifyFrom(0);
     }
 } 
 
 
-template <typename keytype, typename valuetype>
-Heap<keytype,valuetype>::Heap() {
-    CDA<Node<keytype, valuetype>> my_array_;
+template <typename keytype, typename valuetype, int Arity>
+Heap<keytype, valuetype, Arity>::Heap() {
+    for (int i = 0; i < kRootOffset; i++) {
+        keys_.AddEnd(keytype());
+        slots_.AddEnd(-1);
+    }
     heap_size_ = 0;
 } 
 
 
 // Copy Constructor
-template <typename keytype, typename valuetype>
-Heap<keytype,valuetype>::Heap(const Heap<keytype, valuetype> &heap) {
-    my_array_ = heap.my_array_;
+template <typename keytype, typename valuetype, int Arity>
+Heap<keytype, valuetype, Arity>::Heap(const Heap<keytype, valuetype, Arity> &heap) {
+    keys_ = heap.keys_;
+    slots_ = heap.slots_;
+    values_ = heap.values_;
+    positions_ = heap.positions_;
+    free_slots_ = heap.free_slots_;
     heap_size_ = heap.heap_size_;
 }
 
 
 // Copy Assignment Operator
-template <typename keytype, typename valuetype>
-Heap<keytype, valuetype>& Heap<keytype, valuetype>::operator=(const Heap<keytype, valuetype> &heap) {
-    my_array_ = heap.my_array_;
+template <typename keytype, typename valuetype, int Arity>
+Heap<keytype, valuetype, Arity>& Heap<keytype, valuetype, Arity>::operator=(const Heap<keytype, valuetype, Arity> &heap) {
+    keys_ = heap.keys_;
+    slots_ = heap.slots_;
+    values_ = heap.values_;
+    positions_ = heap.positions_;
+    free_slots_ = heap.free_slots_;
     heap_size_ = heap.heap_size_;
     return *this;
 }
 
 
-template <typename keytype, typename valuetype>
-void Heap<keytype,valuetype>::insert(keytype k, valuetype v) {
-    Node<keytype, valuetype> new_node(k, v);
+template <typename keytype, typename valuetype, int Arity>
+int Heap<keytype, valuetype, Arity>::insert(keytype k, valuetype v) {
+    int value_slot = allocateSlot(std::move(v));
     heap_size_++;
-    my_array_.AddEnd(new_node);
+    keys_.AddEnd(std::move(k));
+    slots_.AddEnd(value_slot);
+    positions_[value_slot] = heap_size_ - 1;
     siftUp(heap_size_ - 1);
+    return value_slot;
 }
 
 
-template <typename keytype, typename valuetype>
-void Heap<keytype,valuetype>::siftUp(int node_index) {
-    int parent_index;
-    Node<keytype, valuetype> temp;
-    if (node_index) {
-        parent_index = getParentIndex(node_index);
-        if (my_array_[parent_index] > my_array_[node_index]) {
-            // Swap node and its parent ///////////
-            temp = my_array_[parent_index];
-            my_array_[parent_index] = my_array_[node_index];
-            my_array_[node_index] = temp;
-            siftUp(parent_index);
-            //////////////////////////////////////
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::insertMany(std::span<keytype> keys, std::span<valuetype> values, std::span<int> handles) {
+    if (keys.size() != values.size()) {
+        throw std::invalid_argument("Heap::insertMany needs one value per key");
+    }
+    if (!handles.empty() && handles.size() < keys.size()) {
+        throw std::invalid_argument("Heap::insertMany needs one handle per key");
+    }
+    if (keys.empty()) {
+        return;
+    }
+
+    // Append the whole batch as leaves first, then fix the order once.
+    int old_size = heap_size_;
+    for (std::size_t i = 0; i < keys.size(); i++) {
+        int value_slot = allocateSlot(std::move(values[i]));
+        keys_.AddEnd(std::move(keys[i]));
+        slots_.AddEnd(value_slot);
+        positions_[value_slot] = heap_size_;
+        heap_size_++;
+        if (!handles.empty()) {
+            handles[i] = value_slot;
+        }
+    }
+
+    if (batchHeapifyIsCheaper(old_size)) {
+        heapifyFrom(old_size);
+    }
+    else {
+        // Everything in front of node i is already in heap order, so
+        // sifting the new elements up in index order is enough.
+        for (int i = old_size; i < heap_size_; i++) {
+            siftUp(i);
         }
     }
 }
 
 
-template <typename keytype, typename valuetype>
-void Heap<keytype,valuetype>::siftDown(int node_index) {
-    int left_child_index, right_child_index, min_index;
-    Node<keytype, valuetype> temp;
-    left_child_index = getLeftChildIndex(node_index);
-    right_child_index = getRightChildIndex(node_index);
-    if (right_child_index >= heap_size_) {
-        if (left_child_index >= heap_size_) {
-            return;
-        }
-        else {
-            min_index = left_child_index;
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::insertMany(keytype k[], valuetype v[], int s) {
+    insertMany(std::span<keytype>(k, s), std::span<valuetype>(v, s));
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::decreaseKey(int handle, keytype k) {
+    if (!contains(handle)) {
+        throw std::out_of_range("Heap::decreaseKey handle is not in the heap");
+    }
+    int node_index = positions_[handle];
+    if (key(node_index) < k) {
+        throw std::invalid_argument("Heap::decreaseKey new key is larger");
+    }
+    key(node_index) = k;
+    siftUp(node_index);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::increaseKey(int handle, keytype k) {
+    if (!contains(handle)) {
+        throw std::out_of_range("Heap::increaseKey handle is not in the heap");
+    }
+    int node_index = positions_[handle];
+    if (k < key(node_index)) {
+        throw std::invalid_argument("Heap::increaseKey new key is smaller");
+    }
+    key(node_index) = k;
+    siftDown(node_index);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::erase(int handle) {
+    if (!contains(handle)) {
+        throw std::out_of_range("Heap::erase handle is not in the heap");
+    }
+    removeAt(positions_[handle]);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+bool Heap<keytype, valuetype, Arity>::contains(int handle) const {
+    return handle >= 0 && handle < positions_.Length() && positions_[handle] >= 0;
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+keytype Heap<keytype, valuetype, Arity>::keyOf(int handle) const {
+    if (!contains(handle)) {
+        throw std::out_of_range("Heap::keyOf handle is not in the heap");
+    }
+    return key(positions_[handle]);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::siftUp(int node_index) {
+    // Lift the key out, leaving a hole, and move parents down into the
+    // hole until the key fits. That is one move per level instead of a swap.
+    // Only keys are compared, and only the key and its slot index move.
+    keytype moving_key = key(node_index);
+    int moving_slot = slot(node_index);
+    while (node_index > 0) {
+        int parent_index = getParentIndex(node_index);
+        if (!(key(parent_index) > moving_key)) {
+            break;
         }
+        place(node_index, key(parent_index), slot(parent_index));
+        node_index = parent_index;
     }
-    else {
-        if (my_array_[left_child_index] <= my_array_[right_child_index]) {
-            min_index = left_child_index;
+    place(node_index, moving_key, moving_slot);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::siftDown(int node_index) {
+    keytype moving_key = key(node_index);
+    int moving_slot = slot(node_index);
+    while (true) {
+        int first_child_index = getLeftChildIndex(node_index);
+        if (first_child_index >= heap_size_) {
+            break;
         }
-        else {
-            min_index = right_child_index;
+        int min_index = minChildIndex(first_child_index);
+        if (!(moving_key > key(min_index))) {
+            break;
         }
+        place(node_index, key(min_index), slot(min_index));
+        node_index = min_index;
     }
-    if (my_array_[node_index] > my_array_[min_index]) {
-        temp = my_array_[min_index];
-        my_array_[min_index] = my_array_[node_index];
-        my_array_[node_index] = temp;
-        siftDown(min_index);
-    }
+    place(node_index, moving_key, moving_slot);
+}
 
+
+// Bottom-up (Floyd) sift: a key taken from the last leaf almost always
+// belongs near the bottom, so walk the hole from node_index down to a
+// leaf along the smallest children without comparing against it, then
+// sift it back up, but no higher than node_index. That needs about half
+// the comparisons of a plain siftDown.
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::siftDownBottomUp(int node_index) {
+    keytype moving_key = key(node_index);
+    int moving_slot = slot(node_index);
+    int hole_index = node_index;
+    int first_child_index = getLeftChildIndex(hole_index);
+    while (first_child_index < heap_size_) {
+        int min_index = minChildIndex(first_child_index);
+        place(hole_index, key(min_index), slot(min_index));
+        hole_index = min_index;
+        first_child_index = getLeftChildIndex(hole_index);
+    }
+    while (hole_index > node_index) {
+        int parent_index = getParentIndex(hole_index);
+        if (!(key(parent_index) > moving_key)) {
+            break;
+        }
+        place(hole_index, key(parent_index), slot(parent_index));
+        hole_index = parent_index;
+    }
+    place(hole_index, moving_key, moving_slot);
 }
 
 
-template <typename keytype, typename valuetype>
-void Heap<keytype,valuetype>::printKey() {
-    for (int i = 0; i < my_array_.Length(); i++) {
-        cout << my_array_[i].key << " ";
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::printKey() const {
+    for (int i = 0; i < heap_size_; i++) {
+        cout << key(i) << " ";
     }
     cout << endl;
 }
 
 
-template <typename keytype, typename valuetype>
-keytype Heap<keytype,valuetype>::peekKey() {
-    return my_array_[0].key;
+template <typename keytype, typename valuetype, int Arity>
+keytype Heap<keytype, valuetype, Arity>::peekKey() const {
+    if (heap_size_ == 0) {
+        throw std::out_of_range("Heap::peekKey on an empty heap");
+    }
+    return key(0);
 }
 
 
-template <typename keytype, typename valuetype>
-valuetype Heap<keytype,valuetype>::peekValue() {
-    return my_array_[0].value;
+template <typename keytype, typename valuetype, int Arity>
+valuetype Heap<keytype, valuetype, Arity>::peekValue() const {
+    if (heap_size_ == 0) {
+        throw std::out_of_range("Heap::peekValue on an empty heap");
+    }
+    return values_[slot(0)];
 }
 
 
-template <typename keytype, typename valuetype>
-keytype Heap<keytype,valuetype>::extractMin() {
-    keytype return_key = my_array_[0].key;
-    my_array_[0] = my_array_[heap_size_ - 1];
+template <typename keytype, typename valuetype, int Arity>
+int Heap<keytype, valuetype, Arity>::size() const {
+    return heap_size_;
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+keytype Heap<keytype, valuetype, Arity>::extractMin() {
+    if (heap_size_ == 0) {
+        throw std::out_of_range("Heap::extractMin on an empty heap");
+    }
+    keytype return_key = key(0);
+    releaseSlot(slot(0));
     heap_size_--;
     if (heap_size_ > 0) {
-        siftDown(0);
+        place(0, key(heap_size_), slot(heap_size_));
+        siftDownBottomUp(0);
     }
-    my_array_.DelEnd();
+    keys_.DelEnd();
+    slots_.DelEnd();
     return return_key;
 }
 
 
-template <typename keytype, typename valuetype>
-int Heap<keytype,valuetype>::getParentIndex(int node_index) {
-    return ((node_index - 1) / 2);
+template <typename keytype, typename valuetype, int Arity>
+keytype Heap<keytype, valuetype, Arity>::extractMin(valuetype &value) {
+    if (heap_size_ == 0) {
+        throw std::out_of_range("Heap::extractMin on an empty heap");
+    }
+    // The slot is released right after, so its value can be moved out.
+    value = std::move(values_[slot(0)]);
+    return extractMin();
 }
 
 
-template <typename keytype, typename valuetype>
-int Heap<keytype,valuetype>::getLeftChildIndex(int node_index) {
-    return ((2 * node_index) + 1);
+// The new element takes over the root and its value slot, so the old
+// minimum's handle now refers to the new element.
+template <typename keytype, typename valuetype, int Arity>
+int Heap<keytype, valuetype, Arity>::replaceMin(keytype k, valuetype v) {
+    if (heap_size_ == 0) {
+        throw std::out_of_range("Heap::replaceMin on an empty heap");
+    }
+    int value_slot = slot(0);
+    values_[value_slot] = std::move(v);
+    key(0) = std::move(k);
+    siftDown(0);
+    return value_slot;
 }
 
 
-template <typename keytype, typename valuetype>
-int Heap<keytype,valuetype>::getRightChildIndex(int node_index) {
-    return ((2 * node_index) + 2);
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::extractMinBatch(int k, CDA<Node<keytype, valuetype>> &out) {
+    if (k > heap_size_) {
+        k = heap_size_;
+    }
+    if (k <= 0) {
+        return;
+    }
+
+    // The k smallest are the root plus a subtree hanging from it, so they
+    // can be found without touching the rest of the heap. A candidate heap
+    // holds the frontier, and each candidate taken offers up its children.
+    CDA<int, UncheckedIndex> taken;
+    Heap<keytype, int, Arity> candidates;
+    candidates.insert(key(0), 0);
+    while (taken.Length() < k) {
+        int node_index = candidates.peekValue();
+        candidates.extractMin();
+        taken.AddEnd(node_index);
+        int first_child_index = getLeftChildIndex(node_index);
+        for (int i = first_child_index; i < first_child_index + Arity && i < heap_size_; i++) {
+            candidates.insert(key(i), i);
+        }
+    }
+
+    for (int i = 0; i < k; i++) {
+        int value_slot = slot(taken[i]);
+        out.AddEnd(Node<keytype, valuetype>(key(taken[i]), std::move(values_[value_slot])));
+        positions_[value_slot] = -1;
+    }
+
+    int new_size = heap_size_ - k;
+    if (new_size == 0) {
+        values_.Clear();
+        positions_.Clear();
+        free_slots_.Clear();
+    }
+    else {
+        for (int i = 0; i < k; i++) {
+            free_slots_.AddEnd(slot(taken[i]));
+        }
+
+        // Taken nodes below new_size are holes. Fill them with the elements
+        // in the tail that were not taken (there are exactly as many).
+        CDA<int, UncheckedIndex> holes;
+        for (int i = 0; i < k; i++) {
+            if (taken[i] < new_size) {
+                holes.AddEnd(taken[i]);
+            }
+        }
+        int tail_index = heap_size_ - 1;
+        for (int i = 0; i < holes.Length(); i++) {
+            while (positions_[slot(tail_index)] == -1) {
+                tail_index--;
+            }
+            place(holes[i], key(tail_index), slot(tail_index));
+            tail_index--;
+        }
+
+        // The holes are closed under taking parents, and everything hanging
+        // off them is still a heap, so sifting each hole down after all of
+        // its descendants (Floyd's build on just the holes) restores heap
+        // order. A node was taken after its parent, so the reverse of the
+        // taken order will do. The new keys came from the leaves, so sift
+        // them bottom-up.
+        heap_size_ = new_size;
+        for (int i = holes.Length() - 1; i >= 0; i--) {
+            siftDownBottomUp(holes[i]);
+        }
+    }
+    heap_size_ = new_size;
+    keys_.DelEnd(k);
+    slots_.DelEnd(k);
 }
 
 
-template <typename keytype, typename valuetype>
-Heap<keytype, valuetype>::~Heap() {
+template <typename keytype, typename valuetype, int Arity>
+int Heap<keytype, valuetype, Arity>::getParentIndex(int node_index) {
+    return ((node_index - 1) / Arity);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+int Heap<keytype, valuetype, Arity>::getLeftChildIndex(int node_index) {
+    return ((Arity * node_index) + 1);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+int Heap<keytype, valuetype, Arity>::getRightChildIndex(int node_index) {
+    return ((Arity * node_index) + Arity);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+keytype& Heap<keytype, valuetype, Arity>::key(int node_index) {
+    return keys_[node_index + kRootOffset];
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+const keytype& Heap<keytype, valuetype, Arity>::key(int node_index) const {
+    return keys_[node_index + kRootOffset];
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+int Heap<keytype, valuetype, Arity>::slot(int node_index) const {
+    return slots_[node_index + kRootOffset];
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::place(int node_index, keytype k, int value_slot) {
+    keys_[node_index + kRootOffset] = k;
+    slots_[node_index + kRootOffset] = value_slot;
+    positions_[value_slot] = node_index;
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::removeAt(int node_index) {
+    releaseSlot(slot(node_index));
+    heap_size_--;
+    if (node_index < heap_size_) {
+        // Fill the gap with the last element and let it find its level.
+        place(node_index, key(heap_size_), slot(heap_size_));
+        if (node_index > 0 && key(getParentIndex(node_index)) > key(node_index)) {
+            siftUp(node_index);
+        }
+        else {
+            siftDown(node_index);
+        }
+    }
+    keys_.DelEnd();
+    slots_.DelEnd();
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+int Heap<keytype, valuetype, Arity>::minChildIndex(int first_child_index) {
+    int count = heap_size_ - first_child_index;
+    if (count > Arity) {
+        count = Arity;
+    }
+    // All of the siblings share one sibling group, contiguous in keys_.
+    const keytype* siblings = keys_.Linearize() + first_child_index + kRootOffset;
+    return first_child_index + HeapMinKeyIndex(siblings, count);
+}
+
+
+// Both estimates are worst case comparison counts. Sifting the new
+// elements up costs one comparison per level above each of them.
+// Re-heapifying sifts down every ancestor of the new elements, which
+// costs Arity comparisons per level below each ancestor. The ancestors
+// on one level form a contiguous range, so the sum takes O(log n).
+template <typename keytype, typename valuetype, int Arity>
+bool Heap<keytype, valuetype, Arity>::batchHeapifyIsCheaper(int old_size) {
+    long long depth = 0;
+    for (int i = heap_size_ - 1; i > 0; i = getParentIndex(i)) {
+        depth++;
+    }
+    long long sift_up_cost = (long long)(heap_size_ - old_size) * depth;
+
+    long long heapify_cost = 0;
+    long long height = 1;
+    int low = getParentIndex(old_size);
+    int high = getParentIndex(heap_size_ - 1);
+    while (true) {
+        heapify_cost += (long long)(high - low + 1) * Arity * height;
+        if (low == 0) {
+            break;
+        }
+        low = getParentIndex(low);
+        high = getParentIndex(high);
+        height++;
+    }
+    return heapify_cost < sift_up_cost;
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::heapifyFrom(int old_size) {
+    // Floyd's build, restricted to the ancestors of [old_size, heap_size_).
+    // Walk them a level at a time from the bottom, so every subtree below
+    // a node is a heap again by the time that node is sifted down.
+    int low = getParentIndex(old_size);
+    int high = getParentIndex(heap_size_ - 1);
+    while (true) {
+        for (int i = high; i >= low; i--) {
+            siftDown(i);
+        }
+        if (low == 0) {
+            break;
+        }
+        low = getParentIndex(low);
+        high = getParentIndex(high);
+    }
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+int Heap<keytype, valuetype, Arity>::allocateSlot(valuetype v) {
+    if (free_slots_.Length() > 0) {
+        int value_slot = free_slots_[free_slots_.Length() - 1];
+        free_slots_.DelEnd();
+        values_[value_slot] = std::move(v);
+        return value_slot;
+    }
+    values_.AddEnd(std::move(v));
+    positions_.AddEnd(-1);
+    return values_.Length() - 1;
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void Heap<keytype, valuetype, Arity>::releaseSlot(int value_slot) {
+    if (heap_size_ == 1) {
+        // The heap is about to be empty, drop the whole value pool.
+        values_.Clear();
+        positions_.Clear();
+        free_slots_.Clear();
+        return;
+    }
+    // Don't keep a removed value (and whatever it owns) alive until the
+    // slot happens to be reused.
+    if constexpr (!std::is_trivially_destructible<valuetype>::value) {
+        values_[value_slot] = valuetype();
+    }
+    positions_[value_slot] = -1;
+    free_slots_.AddEnd(value_slot);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+Heap<keytype, valuetype, Arity>::~Heap() {
 }
 
 
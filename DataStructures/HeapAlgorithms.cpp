@@ -0,0 +1,236 @@
+/*
+ * Binary heap algorithms over an existing array.
+ *
+ * MakeHeap, PushHeap, PopHeap and SortHeap arrange elements into
+ * a binary heap in place, in the array they already live in, with
+ * no Node records, handles or extra allocation. They work on a
+ * CDA, on a std::span, or on a pointer and a length:
+ *    CDA<int> queue;
+ *    queue.AddEnd(5);
+ *    PushHeap(queue);               // queue is now a min heap
+ *    PopHeap(queue);                // the minimum moves to the end
+ *    queue.DelEnd();
+ *
+ * Every function takes an order: order(a, b) is true when a
+ * belongs above b. MinHeapOrder (the default) puts the smallest
+ * element on top, like Heap, and MaxHeapOrder the largest. Any
+ * callable that is a strict weak ordering will do, e.g. a lambda
+ * comparing one field.
+ *
+ *    MakeHeap(data, n)      arranges data[0..n-1] into a heap, O(n)
+ *    PushHeap(data, n)      adds data[n-1] to the heap data[0..n-2]
+ *    PopHeap(data, n)       moves the top to data[n-1], and leaves
+ *                           data[0..n-2] a heap
+ *    SortHeap(data, n)      pops the whole heap: the elements end up
+ *                           in reverse order (a min heap sorts
+ *                           descending)
+ *    HeapSort(data, n)      sorts ascending by the order (so with the
+ *                           default, smallest first)
+ *
+ * HeapSort is O(n log n) in the worst case and needs O(1) extra
+ * memory, unlike CDA::QuickSort. PopHeap sifts the hole at the
+ * root down to a leaf before moving the last element up into it
+ * (Floyd), which saves about half of the comparisons of a plain
+ * sift down, since the last element nearly always belongs near the
+ * bottom.
+ *
+ * The CDA overloads call Linearize first, which only moves the
+ * elements when they wrap around the end of the buffer. MakeHeap,
+ * PushHeap and PopHeap clear the CDA's ordered flag (used by Search)
+ * without scanning, so a heap is never treated as sorted, and
+ * SortHeap and HeapSort set it by checking the result once. Requires
+ * C++20 (for std::span).
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef HEAP_ALGORITHMS_CPP
+#define HEAP_ALGORITHMS_CPP
+
+#include <span>
+#include <utility>
+#include "CDA.cpp"
+
+
+// MinHeapOrder puts the smallest element on top. It is usable in constant expressions.
+struct MinHeapOrder {
+    template <typename T>
+    constexpr bool operator()(const T &a, const T &b) const { return a < b; }
+};
+
+
+// MaxHeapOrder puts the largest element on top.
+struct MaxHeapOrder {
+    template <typename T>
+    constexpr bool operator()(const T &a, const T &b) const { return b < a; }
+};
+
+
+// Move data[node_index] up towards the root until its parent belongs above it.
+template <typename T, typename Order>
+constexpr void HeapSiftUp(T* data, int node_index, Order order) {
+    T moving = std::move(data[node_index]);
+    while (node_index > 0) {
+        int parent_index = (node_index - 1) / 2;
+        if (!order(moving, data[parent_index])) {
+            break;
+        }
+        data[node_index] = std::move(data[parent_index]);
+        node_index = parent_index;
+    }
+    data[node_index] = std::move(moving);
+}
+
+
+// Move data[node_index] down until neither child of the first length elements belongs above it.
+template <typename T, typename Order>
+constexpr void HeapSiftDown(T* data, int length, int node_index, Order order) {
+    T moving = std::move(data[node_index]);
+    while (2 * node_index + 1 < length) {
+        int child_index = 2 * node_index + 1;
+        if (child_index + 1 < length && order(data[child_index + 1], data[child_index])) {
+            child_index++;
+        }
+        if (!order(data[child_index], moving)) {
+            break;
+        }
+        data[node_index] = std::move(data[child_index]);
+        node_index = child_index;
+    }
+    data[node_index] = std::move(moving);
+}
+
+
+template <typename T, typename Order = MinHeapOrder>
+constexpr void MakeHeap(T* data, int length, Order order = Order()) {
+    for (int i = length / 2 - 1; i >= 0; i--) {
+        HeapSiftDown(data, length, i, order);
+    }
+}
+
+
+template <typename T, typename Order = MinHeapOrder>
+constexpr void PushHeap(T* data, int length, Order order = Order()) {
+    if (length > 1) {
+        HeapSiftUp(data, length - 1, order);
+    }
+}
+
+
+template <typename T, typename Order = MinHeapOrder>
+constexpr void PopHeap(T* data, int length, Order order = Order()) {
+    if (length < 2) {
+        return;
+    }
+    T top = std::move(data[0]);
+    T last = std::move(data[length - 1]);
+    length--;
+
+    // Walk the hole at the root down to a leaf, always following the child
+    // that belongs higher, then put the last element in and sift it up.
+    int node_index = 0;
+    while (2 * node_index + 2 < length) {
+        int child_index = 2 * node_index + 1;
+        if (order(data[child_index + 1], data[child_index])) {
+            child_index++;
+        }
+        data[node_index] = std::move(data[child_index]);
+        node_index = child_index;
+    }
+    if (2 * node_index + 1 < length) {
+        data[node_index] = std::move(data[2 * node_index + 1]);
+        node_index = 2 * node_index + 1;
+    }
+    data[node_index] = std::move(last);
+    HeapSiftUp(data, node_index, order);
+    data[length] = std::move(top);
+}
+
+
+template <typename T, typename Order = MinHeapOrder>
+constexpr void SortHeap(T* data, int length, Order order = Order()) {
+    for (int i = length; i > 1; i--) {
+        PopHeap(data, i, order);
+    }
+}
+
+
+template <typename T, typename Order = MinHeapOrder>
+constexpr void HeapSort(T* data, int length, Order order = Order()) {
+    // SortHeap leaves a heap in reverse order, so build it upside down.
+    auto reversed = [order](const T &a, const T &b) { return order(b, a); };
+    MakeHeap(data, length, reversed);
+    SortHeap(data, length, reversed);
+}
+
+
+// std::span overloads.
+template <typename T, typename Order = MinHeapOrder>
+constexpr void MakeHeap(std::span<T> data, Order order = Order()) {
+    MakeHeap(data.data(), (int)data.size(), order);
+}
+
+
+template <typename T, typename Order = MinHeapOrder>
+constexpr void PushHeap(std::span<T> data, Order order = Order()) {
+    PushHeap(data.data(), (int)data.size(), order);
+}
+
+
+template <typename T, typename Order = MinHeapOrder>
+constexpr void PopHeap(std::span<T> data, Order order = Order()) {
+    PopHeap(data.data(), (int)data.size(), order);
+}
+
+
+template <typename T, typename Order = MinHeapOrder>
+constexpr void SortHeap(std::span<T> data, Order order = Order()) {
+    SortHeap(data.data(), (int)data.size(), order);
+}
+
+
+template <typename T, typename Order = MinHeapOrder>
+constexpr void HeapSort(std::span<T> data, Order order = Order()) {
+    HeapSort(data.data(), (int)data.size(), order);
+}
+
+
+// CDA overloads, over all of the CDA's elements.
+template <typename T, typename IndexPolicy, typename Order = MinHeapOrder>
+void MakeHeap(CDA<T, IndexPolicy> &cda, Order order = Order()) {
+    MakeHeap(cda.Linearize(), cda.Length(), order);
+    cda.ClearOrdered();
+}
+
+
+template <typename T, typename IndexPolicy, typename Order = MinHeapOrder>
+void PushHeap(CDA<T, IndexPolicy> &cda, Order order = Order()) {
+    PushHeap(cda.Linearize(), cda.Length(), order);
+    cda.ClearOrdered();
+}
+
+
+template <typename T, typename IndexPolicy, typename Order = MinHeapOrder>
+void PopHeap(CDA<T, IndexPolicy> &cda, Order order = Order()) {
+    PopHeap(cda.Linearize(), cda.Length(), order);
+    cda.ClearOrdered();
+}
+
+
+template <typename T, typename IndexPolicy, typename Order = MinHeapOrder>
+void SortHeap(CDA<T, IndexPolicy> &cda, Order order = Order()) {
+    SortHeap(cda.Linearize(), cda.Length(), order);
+    cda.SetOrdered();
+}
+
+
+template <typename T, typename IndexPolicy, typename Order = MinHeapOrder>
+void HeapSort(CDA<T, IndexPolicy> &cda, Order order = Order()) {
+    HeapSort(cda.Linearize(), cda.Length(), order);
+    cda.SetOrdered();
+}
+
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ * Implementation of a Min-Max Heap (a double-ended priority queue).
+ *
+ * This file contains one class:
+ * 1. MinMaxHeap
+ *
+ * MinMaxHeap is templated with two typenames, keytype and
+ * valuetype, and stores its elements as Node records (see
+ * Heap.cpp) in a CDA:
+ *    MinMaxHeap<keytype, valuetype> that_name;
+ *
+ * This is Atkinson et al.'s min-max heap. It is a complete
+ * binary tree like Heap, but the levels alternate: a node on an
+ * even level (the root is level 0) is the smallest key of its
+ * subtree, and a node on an odd level is the largest. So the
+ * minimum is the root and the maximum is one of its two
+ * children, which makes peekMin and peekMax O(1), while insert,
+ * extractMin and extractMax are O(log n). One MinMaxHeap takes
+ * the place of a min Heap and a max Heap kept in sync, with
+ * half of the memory and without updating both on every change.
+ *
+ * Removing from an empty MinMaxHeap throws std::out_of_range.
+ * Requires C++20 (for std::bit_width).
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef MIN_MAX_HEAP_CPP
+#define MIN_MAX_HEAP_CPP
+
+#include <bit>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include "CDA.cpp"
+#include "Heap.cpp"
+
+
+// MinMaxHeap is a binary heap ordered by min on even levels and by max on odd levels
+template <typename keytype, typename valuetype>
+class MinMaxHeap {
+public:
+    MinMaxHeap();                                   // Default Constructor for empty MinMaxHeap
+    MinMaxHeap(keytype k[], valuetype v[], int s);  // Constructor with keys k[], values v[], size s
+
+    void insert(keytype k, valuetype v);            // Inserts key k and value v
+    Node<keytype, valuetype> peekMin();             // Return the element with the smallest key
+    Node<keytype, valuetype> peekMax();             // Return the element with the largest key
+    Node<keytype, valuetype> extractMin();          // Remove and return the element with the smallest key
+    Node<keytype, valuetype> extractMax();          // Remove and return the element with the largest key
+    int size();                                     // Return the number of elements
+    void printKey();                                // Writes the keys in array, starting at root
+
+private:
+    bool isMinLevel(int node_index);                // True if node_index is on an even (min) level
+    int maxIndex();                                 // The index of the largest key, size must be > 0
+    bool less(int a, int b);                        // nodes_[a].key < nodes_[b].key
+    void swapNodes(int a, int b);
+    void pushUp(int node_index);                    // Restore order after adding a node at node_index
+    template <bool Min>
+    void pushUpAlong(int node_index);               // Move up through grandparents on min (or max) levels
+    void trickleDown(int node_index);               // Restore order after replacing the node at node_index
+    template <bool Min>
+    void trickleDownAlong(int node_index);          // trickleDown for a node on a min (or max) level
+    Node<keytype, valuetype> removeAt(int node_index);
+
+    CDA<Node<keytype, valuetype>, UncheckedIndex> nodes_;
+};
+
+
+template <typename keytype, typename valuetype>
+MinMaxHeap<keytype, valuetype>::MinMaxHeap() {
+}
+
+
+template <typename keytype, typename valuetype>
+MinMaxHeap<keytype, valuetype>::MinMaxHeap(keytype k[], valuetype v[], int s) {
+    for (int i = 0; i < s; i++) {
+        nodes_.AddEnd(Node<keytype, valuetype>(k[i], v[i]));
+    }
+    // Floyd's build works here too: every subtree below i is already a
+    // min-max heap when trickleDown(i) runs.
+    for (int i = s / 2 - 1; i >= 0; i--) {
+        trickleDown(i);
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+void MinMaxHeap<keytype, valuetype>::insert(keytype k, valuetype v) {
+    nodes_.AddEnd(Node<keytype, valuetype>(std::move(k), std::move(v)));
+    pushUp(nodes_.Length() - 1);
+}
+
+
+template <typename keytype, typename valuetype>
+Node<keytype, valuetype> MinMaxHeap<keytype, valuetype>::peekMin() {
+    if (nodes_.Length() == 0) {
+        throw std::out_of_range("MinMaxHeap::peekMin on an empty heap");
+    }
+    return nodes_[0];
+}
+
+
+template <typename keytype, typename valuetype>
+Node<keytype, valuetype> MinMaxHeap<keytype, valuetype>::peekMax() {
+    if (nodes_.Length() == 0) {
+        throw std::out_of_range("MinMaxHeap::peekMax on an empty heap");
+    }
+    return nodes_[maxIndex()];
+}
+
+
+template <typename keytype, typename valuetype>
+Node<keytype, valuetype> MinMaxHeap<keytype, valuetype>::extractMin() {
+    if (nodes_.Length() == 0) {
+        throw std::out_of_range("MinMaxHeap::extractMin on an empty heap");
+    }
+    return removeAt(0);
+}
+
+
+template <typename keytype, typename valuetype>
+Node<keytype, valuetype> MinMaxHeap<keytype, valuetype>::extractMax() {
+    if (nodes_.Length() == 0) {
+        throw std::out_of_range("MinMaxHeap::extractMax on an empty heap");
+    }
+    return removeAt(maxIndex());
+}
+
+
+template <typename keytype, typename valuetype>
+int MinMaxHeap<keytype, valuetype>::size() {
+    return nodes_.Length();
+}
+
+
+template <typename keytype, typename valuetype>
+void MinMaxHeap<keytype, valuetype>::printKey() {
+    for (int i = 0; i < nodes_.Length(); i++) {
+        cout << nodes_[i].key << " ";
+    }
+    cout << endl;
+}
+
+
+template <typename keytype, typename valuetype>
+bool MinMaxHeap<keytype, valuetype>::isMinLevel(int node_index) {
+    // Node i is on level bit_width(i + 1) - 1.
+    return (std::bit_width((unsigned int)node_index + 1) & 1) == 1;
+}
+
+
+template <typename keytype, typename valuetype>
+int MinMaxHeap<keytype, valuetype>::maxIndex() {
+    if (nodes_.Length() == 1) {
+        return 0;
+    }
+    if (nodes_.Length() == 2 || less(2, 1)) {
+        return 1;
+    }
+    return 2;
+}
+
+
+template <typename keytype, typename valuetype>
+bool MinMaxHeap<keytype, valuetype>::less(int a, int b) {
+    return nodes_[a].key < nodes_[b].key;
+}
+
+
+template <typename keytype, typename valuetype>
+void MinMaxHeap<keytype, valuetype>::swapNodes(int a, int b) {
+    std::swap(nodes_[a], nodes_[b]);
+}
+
+
+template <typename keytype, typename valuetype>
+void MinMaxHeap<keytype, valuetype>::pushUp(int node_index) {
+    if (node_index == 0) {
+        return;
+    }
+    int parent_index = (node_index - 1) / 2;
+    if (isMinLevel(node_index)) {
+        // The parent is the max of a subtree this node joined.
+        if (less(parent_index, node_index)) {
+            swapNodes(node_index, parent_index);
+            pushUpAlong<false>(parent_index);
+        }
+        else {
+            pushUpAlong<true>(node_index);
+        }
+    }
+    else {
+        if (less(node_index, parent_index)) {
+            swapNodes(node_index, parent_index);
+            pushUpAlong<true>(parent_index);
+        }
+        else {
+            pushUpAlong<false>(node_index);
+        }
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+template <bool Min>
+void MinMaxHeap<keytype, valuetype>::pushUpAlong(int node_index) {
+    // Levels of one kind are two apart, so compare with the grandparent,
+    // moving grandparents down into the hole instead of swapping.
+    Node<keytype, valuetype> moving = std::move(nodes_[node_index]);
+    while (node_index > 2) {
+        int grandparent_index = ((node_index - 1) / 2 - 1) / 2;
+        bool out_of_order = Min ? (moving.key < nodes_[grandparent_index].key)
+                                : (nodes_[grandparent_index].key < moving.key);
+        if (!out_of_order) {
+            break;
+        }
+        nodes_[node_index] = std::move(nodes_[grandparent_index]);
+        node_index = grandparent_index;
+    }
+    nodes_[node_index] = std::move(moving);
+}
+
+
+template <typename keytype, typename valuetype>
+void MinMaxHeap<keytype, valuetype>::trickleDown(int node_index) {
+    if (isMinLevel(node_index)) {
+        trickleDownAlong<true>(node_index);
+    }
+    else {
+        trickleDownAlong<false>(node_index);
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+template <bool Min>
+void MinMaxHeap<keytype, valuetype>::trickleDownAlong(int node_index) {
+    int length = nodes_.Length();
+    while (2 * node_index + 1 < length) {
+        // Find the smallest (or largest) of the children and grandchildren.
+        int first_child_index = 2 * node_index + 1;
+        int best_index = first_child_index;
+        int candidates[5] = {first_child_index + 1,
+                             2 * first_child_index + 1, 2 * first_child_index + 2,
+                             2 * first_child_index + 3, 2 * first_child_index + 4};
+        for (int i = 0; i < 5 && candidates[i] < length; i++) {
+            if (Min ? less(candidates[i], best_index) : less(best_index, candidates[i])) {
+                best_index = candidates[i];
+            }
+        }
+
+        bool out_of_order = Min ? less(best_index, node_index) : less(node_index, best_index);
+        if (!out_of_order) {
+            return;
+        }
+        swapNodes(node_index, best_index);
+        if (best_index <= first_child_index + 1) {
+            // A child has no descendants of this node's kind below it.
+            return;
+        }
+        // The moved key may now be on the wrong side of the grandchild's parent.
+        int parent_index = (best_index - 1) / 2;
+        if (Min ? less(parent_index, best_index) : less(best_index, parent_index)) {
+            swapNodes(best_index, parent_index);
+        }
+        node_index = best_index;
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+Node<keytype, valuetype> MinMaxHeap<keytype, valuetype>::removeAt(int node_index) {
+    Node<keytype, valuetype> removed = std::move(nodes_[node_index]);
+    int last_index = nodes_.Length() - 1;
+    if (node_index != last_index) {
+        nodes_[node_index] = std::move(nodes_[last_index]);
+    }
+    nodes_.DelEnd();
+    if (node_index < nodes_.Length()) {
+        trickleDown(node_index);
+    }
+    return removed;
+}
+
+
+#endif
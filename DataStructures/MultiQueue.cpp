@@ -0,0 +1,223 @@
+/*
+ * Implementation of a MultiQueue, a relaxed concurrent priority queue.
+ *
+ * This file contains one class:
+ * 1. MultiQueue
+ *
+ * MultiQueue is templated like Heap, with keytype, valuetype and
+ * an optional Arity, and is built out of c * p Heap shards for p
+ * threads (c shards per thread, 2 by default):
+ *    MultiQueue<keytype, valuetype> that_name(threads);
+ *
+ * Each shard is a Heap with its own mutex, padded to a cache line
+ * so shards never share one. insert puts the element into a random
+ * shard. extractMin looks at two random shards, and removes the
+ * minimum of whichever has the smaller top key. Shards are
+ * try-locked: a thread that finds a shard busy just picks other
+ * shards instead of waiting, so with enough shards threads almost
+ * never contend. (Only the sweep that decides the queue is empty
+ * waits for locks.) The top key and size of every shard are
+ * also published in atomics, so choosing between two shards does
+ * not take any lock.
+ *
+ * The price is that extractMin is relaxed: it does not always
+ * return the smallest key in the queue. Its rank error (how many
+ * smaller keys are still queued) is O(c * p) in expectation and
+ * O(c * p * log(c * p)) with high probability, for uniformly
+ * random shard choices (Alistarh et al., "The Power of Choice in
+ * Priority Scheduling", PODC 2017). More shards per thread means
+ * less contention but a larger error.
+ *
+ * extractMin returns false when every shard was empty at the
+ * moment it was checked; under concurrent inserts that is only a
+ * snapshot. keytype must be trivially copyable (to be published
+ * in a std::atomic).
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef MULTI_QUEUE_CPP
+#define MULTI_QUEUE_CPP
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "Heap.cpp"
+
+
+// MultiQueue is a relaxed concurrent Min-Ordered priority queue of Heap shards
+template <typename keytype, typename valuetype, int Arity = 2>
+class MultiQueue {
+    static_assert(std::is_trivially_copyable<keytype>::value, "MultiQueue publishes shard top keys in std::atomic");
+
+public:
+    MultiQueue(int threads, int shards_per_thread = 2);
+    MultiQueue(const MultiQueue &) = delete;
+    MultiQueue& operator=(const MultiQueue &) = delete;
+
+    void insert(keytype k, valuetype v);            // Insert into a random shard
+    bool extractMin(keytype &k, valuetype &v);      // Remove a near-minimum element, false if the queue looked empty
+    int size();                                     // Number of elements, exact only when no thread is working
+    int shards();                                   // Number of Heap shards (c * p)
+    ~MultiQueue();
+
+private:
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        Heap<keytype, valuetype, Arity> heap;
+        std::atomic<keytype> top;                   // heap.peekKey(), valid while size > 0
+        std::atomic<int> size;                      // heap.size()
+    };
+
+    int randomShard();                              // A uniformly random shard index for this thread
+    void publish(Shard &shard);                     // Update shard.top and shard.size, shard must be locked
+    bool extractFrom(Shard &shard, keytype &k, valuetype &v);
+                                                    // Remove shard's minimum, the shard must be locked
+
+    Shard* shards_;
+    int shard_count_;
+};
+
+
+template <typename keytype, typename valuetype, int Arity>
+MultiQueue<keytype, valuetype, Arity>::MultiQueue(int threads, int shards_per_thread) {
+    if (threads < 1 || shards_per_thread < 1) {
+        throw std::invalid_argument("MultiQueue needs at least one thread and one shard per thread");
+    }
+    // Two shards at least, so extractMin always has two to choose from.
+    shard_count_ = threads * shards_per_thread;
+    if (shard_count_ < 2) {
+        shard_count_ = 2;
+    }
+    shards_ = new Shard[shard_count_];
+    for (int i = 0; i < shard_count_; i++) {
+        shards_[i].size.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void MultiQueue<keytype, valuetype, Arity>::insert(keytype k, valuetype v) {
+    while (true) {
+        Shard &shard = shards_[randomShard()];
+        if (shard.mutex.try_lock()) {
+            shard.heap.insert(std::move(k), std::move(v));
+            publish(shard);
+            shard.mutex.unlock();
+            return;
+        }
+    }
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+bool MultiQueue<keytype, valuetype, Arity>::extractMin(keytype &k, valuetype &v) {
+    int misses = 0;
+    while (true) {
+        // Two random shards, compared by their published tops without locking.
+        int first = randomShard();
+        int second = randomShard();
+        int first_size = shards_[first].size.load(std::memory_order_acquire);
+        int second_size = shards_[second].size.load(std::memory_order_acquire);
+        int best = -1;
+        if (first_size > 0 && second_size > 0) {
+            keytype first_top = shards_[first].top.load(std::memory_order_relaxed);
+            keytype second_top = shards_[second].top.load(std::memory_order_relaxed);
+            best = (second_top < first_top) ? second : first;
+        }
+        else if (first_size > 0) {
+            best = first;
+        }
+        else if (second_size > 0) {
+            best = second;
+        }
+
+        if (best >= 0 && shards_[best].mutex.try_lock()) {
+            bool found = extractFrom(shards_[best], k, v);
+            shards_[best].mutex.unlock();
+            if (found) {
+                return true;
+            }
+        }
+
+        // Random picks keep missing, which happens when the queue is (nearly)
+        // empty. Sweep every shard before reporting it empty.
+        if (++misses >= shard_count_) {
+            bool all_empty = true;
+            for (int i = 0; i < shard_count_; i++) {
+                if (shards_[i].size.load(std::memory_order_acquire) > 0) {
+                    all_empty = false;
+                    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+                    if (extractFrom(shards_[i], k, v)) {
+                        return true;
+                    }
+                }
+            }
+            if (all_empty) {
+                return false;
+            }
+            misses = 0;
+        }
+    }
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+int MultiQueue<keytype, valuetype, Arity>::size() {
+    int total = 0;
+    for (int i = 0; i < shard_count_; i++) {
+        total += shards_[i].size.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+int MultiQueue<keytype, valuetype, Arity>::shards() {
+    return shard_count_;
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+int MultiQueue<keytype, valuetype, Arity>::randomShard() {
+    thread_local std::minstd_rand generator((unsigned int)std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return (int)(generator() % (unsigned int)shard_count_);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+void MultiQueue<keytype, valuetype, Arity>::publish(Shard &shard) {
+    int size = shard.heap.size();
+    if (size > 0) {
+        shard.top.store(shard.heap.peekKey(), std::memory_order_relaxed);
+    }
+    shard.size.store(size, std::memory_order_release);
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+bool MultiQueue<keytype, valuetype, Arity>::extractFrom(Shard &shard, keytype &k, valuetype &v) {
+    // Another thread may have emptied the shard since its size was read.
+    if (shard.heap.size() == 0) {
+        return false;
+    }
+    k = shard.heap.extractMin(v);
+    publish(shard);
+    return true;
+}
+
+
+template <typename keytype, typename valuetype, int Arity>
+MultiQueue<keytype, valuetype, Arity>::~MultiQueue() {
+    delete[] shards_;
+}
+
+
+#endif
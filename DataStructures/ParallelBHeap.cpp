@@ -0,0 +1,251 @@
+/*
+ * Parallel merging of BHeaps, and a concurrent ingest front end.
+ *
+ * This file contains one function and one class:
+ * 1. MergeAll
+ * 2. ParallelBHeap
+ *
+ * MergeAll merges an array of BHeaps into the first one as a
+ * tree reduction: in round r, heaps[i + 2^r] is merged into
+ * heaps[i] for every i that is a multiple of 2^(r + 1), and the
+ * merges of a round are shared out between threads:
+ *    BHeap<keytype, valuetype>* heaps[] = {&a, &b, &c, &d};
+ *    MergeAll(heaps, 4, 2);         // a holds everything, b, c, d are empty
+ * A merge moves pointers and slab lists, never nodes, so p heaps
+ * take ceil(log2 p) rounds of O(log n) work each (for LAZY heaps,
+ * one step per slab taken over). The heaps must be distinct, and no other thread
+ * may use them during the call. With threads = 1 (the default)
+ * nothing is spawned. A merge is cheap enough that starting
+ * threads only pays off for a large number of heaps.
+ *
+ * ParallelBHeap is templated like BHeap, with keytype and
+ * valuetype, and collects elements from many producer threads:
+ *    ParallelBHeap<keytype, valuetype> that_name(producers);
+ *    that_name.insert(producer_id, k, v);     // any number of threads
+ *    that_name.extractMin(k, v);               // consumers
+ *
+ * Every producer inserts into its own BHeap shard, guarded by a
+ * mutex that only a collect ever contends for, and padded to a
+ * cache line so shards never share one. insert(k, v) without an
+ * id picks a shard from the calling thread's id. Consumers work on
+ * one more BHeap, the merged heap. collect() takes every shard's
+ * heap (holding each shard lock for a single merge) and melds them
+ * into the merged heap with MergeAll. extractMin collects on its
+ * own only when the merged heap is empty, so it returns the
+ * minimum of everything collected so far, not necessarily of
+ * everything inserted; call collect() to bring the merged heap up
+ * to date. Shards and the merged heap are EAGER unless another mode
+ * is given. LAZY shards make insert and every merge O(1), but
+ * then the first extractMin after a collect links every element
+ * inserted since, in one O(n) pass.
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef PARALLEL_BHEAP_CPP
+#define PARALLEL_BHEAP_CPP
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "BHeap.cpp"
+
+
+// Merge heaps[1..count-1] into heaps[0] as a parallel tree reduction, leaving the others empty
+template <typename keytype, typename valuetype>
+void MergeAll(BHeap<keytype, valuetype>* heaps[], int count, int threads = 1) {
+    if (threads < 1) {
+        throw std::invalid_argument("MergeAll needs at least one thread");
+    }
+    for (int stride = 1; stride < count; stride *= 2) {
+        int pairs = (count - stride + 2 * stride - 1) / (2 * stride);
+        int workers = threads < pairs ? threads : pairs;
+
+        // Worker w merges pairs w, w + workers, w + 2 * workers, ... of this round.
+        auto mergePairs = [heaps, count, stride, workers](int worker) {
+            for (int i = 2 * stride * worker; i + stride < count; i += 2 * stride * workers) {
+                heaps[i]->merge(*heaps[i + stride]);
+            }
+        };
+        if (workers == 1) {
+            mergePairs(0);
+            continue;
+        }
+
+        std::thread* pool = new std::thread[workers - 1];
+        std::exception_ptr* errors = new std::exception_ptr[workers];
+        for (int w = 1; w < workers; w++) {
+            pool[w - 1] = std::thread([&mergePairs, errors, w]() {
+                try {
+                    mergePairs(w);
+                }
+                catch (...) {
+                    errors[w] = std::current_exception();
+                }
+            });
+        }
+        try {
+            mergePairs(0);
+        }
+        catch (...) {
+            errors[0] = std::current_exception();
+        }
+        for (int w = 0; w < workers - 1; w++) {
+            pool[w].join();
+        }
+        delete[] pool;
+
+        std::exception_ptr error = nullptr;
+        for (int w = 0; w < workers && error == nullptr; w++) {
+            error = errors[w];
+        }
+        delete[] errors;
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+
+// ParallelBHeap gathers inserts from many threads into per-producer BHeaps and melds them on demand
+template <typename keytype, typename valuetype>
+class ParallelBHeap {
+public:
+    ParallelBHeap(int producers, BHeapMode mode = EAGER);
+    ParallelBHeap(const ParallelBHeap &) = delete;
+    ParallelBHeap& operator=(const ParallelBHeap &) = delete;
+
+    void insert(int producer, keytype k, valuetype v);  // Insert into producer's shard
+    void insert(keytype k, valuetype v);                // Insert into the shard of the calling thread
+    void collect(int threads = 1);                      // Meld every shard into the merged heap
+    bool extractMin(keytype &k, valuetype &v);          // Remove the merged heap's minimum, false if nothing was collected
+    bool peekMin(keytype &k, valuetype &v);             // Read the merged heap's minimum, false if nothing was collected
+    int producers();                                    // Number of shards
+    ~ParallelBHeap();
+
+private:
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        BHeap<keytype, valuetype> heap;
+    };
+
+    void gather(int threads);                           // Take every shard's heap and meld it in, merge_mutex_ must be held
+    bool collectIfEmpty();                              // gather if the merged heap is empty, false if it still is
+
+    Shard* shards_;
+    int shard_count_;
+    BHeap<keytype, valuetype>* staging_;                // staging_[0] is the merged heap, staging_[i + 1] receives shard i
+    BHeap<keytype, valuetype>** staging_ptrs_;          // &staging_[i], for MergeAll
+    std::mutex merge_mutex_;                            // Guards staging_, taken before any shard mutex
+};
+
+
+template <typename keytype, typename valuetype>
+ParallelBHeap<keytype, valuetype>::ParallelBHeap(int producers, BHeapMode mode) {
+    if (producers < 1) {
+        throw std::invalid_argument("ParallelBHeap needs at least one producer");
+    }
+    shard_count_ = producers;
+    shards_ = new Shard[shard_count_];
+    staging_ = new BHeap<keytype, valuetype>[shard_count_ + 1];
+    staging_ptrs_ = new BHeap<keytype, valuetype>*[shard_count_ + 1];
+    for (int i = 0; i < shard_count_; i++) {
+        shards_[i].heap = BHeap<keytype, valuetype>(mode);
+    }
+    for (int i = 0; i <= shard_count_; i++) {
+        staging_[i] = BHeap<keytype, valuetype>(mode);
+        staging_ptrs_[i] = &staging_[i];
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+void ParallelBHeap<keytype, valuetype>::insert(int producer, keytype k, valuetype v) {
+    if (producer < 0 || producer >= shard_count_) {
+        throw std::out_of_range("ParallelBHeap::insert producer out of range");
+    }
+    std::lock_guard<std::mutex> lock(shards_[producer].mutex);
+    shards_[producer].heap.insert(std::move(k), std::move(v));
+}
+
+
+template <typename keytype, typename valuetype>
+void ParallelBHeap<keytype, valuetype>::insert(keytype k, valuetype v) {
+    thread_local std::size_t thread_hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    insert((int)(thread_hash % (std::size_t)shard_count_), std::move(k), std::move(v));
+}
+
+
+template <typename keytype, typename valuetype>
+void ParallelBHeap<keytype, valuetype>::collect(int threads) {
+    std::lock_guard<std::mutex> merge_lock(merge_mutex_);
+    gather(threads);
+}
+
+
+template <typename keytype, typename valuetype>
+bool ParallelBHeap<keytype, valuetype>::extractMin(keytype &k, valuetype &v) {
+    std::lock_guard<std::mutex> merge_lock(merge_mutex_);
+    if (!collectIfEmpty()) {
+        return false;
+    }
+    v = staging_[0].peekValue();
+    k = staging_[0].extractMin();
+    return true;
+}
+
+
+template <typename keytype, typename valuetype>
+bool ParallelBHeap<keytype, valuetype>::peekMin(keytype &k, valuetype &v) {
+    std::lock_guard<std::mutex> merge_lock(merge_mutex_);
+    if (!collectIfEmpty()) {
+        return false;
+    }
+    k = staging_[0].peekKey();
+    v = staging_[0].peekValue();
+    return true;
+}
+
+
+template <typename keytype, typename valuetype>
+int ParallelBHeap<keytype, valuetype>::producers() {
+    return shard_count_;
+}
+
+
+template <typename keytype, typename valuetype>
+bool ParallelBHeap<keytype, valuetype>::collectIfEmpty() {
+    if (staging_[0].getHead() == nullptr) {
+        gather(1);
+    }
+    return staging_[0].getHead() != nullptr;
+}
+
+
+template <typename keytype, typename valuetype>
+void ParallelBHeap<keytype, valuetype>::gather(int threads) {
+    // Each shard is locked only while its nodes are taken, the melding
+    // happens while producers carry on inserting.
+    for (int i = 0; i < shard_count_; i++) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        staging_[i + 1].merge(shards_[i].heap);
+    }
+    MergeAll(staging_ptrs_, shard_count_ + 1, threads);
+}
+
+
+template <typename keytype, typename valuetype>
+ParallelBHeap<keytype, valuetype>::~ParallelBHeap() {
+    delete[] staging_ptrs_;
+    delete[] staging_;
+    delete[] shards_;
+}
+
+
+#endif
@@ -0,0 +1,530 @@
+/*
+ * Implementation of a crash-safe, memory-mapped Persistent Heap.
+ *
+ * This file contains one class:
+ * 1. PersistentHeap
+ *
+ * PersistentHeap is templated with two typenames, keytype and
+ * valuetype, and has the insert/peekKey/peekValue/extractMin
+ * surface of Heap, but its contents survive a restart:
+ *    PersistentHeap<keytype, valuetype> jobs("/var/lib/app/jobs");
+ *
+ * State lives in two files:
+ * 1. The heap file (path) holds a header and the Node records in
+ *    binary min-heap order, exactly as they sit in memory. It is
+ *    mapped copy-on-write (MAP_PRIVATE) at the front of a reserved
+ *    address range, so opening it needs no parsing or rebuild, and
+ *    changes made in memory never reach it. It is only replaced,
+ *    atomically, by checkpoint(), so it is always a valid heap as
+ *    of the last checkpoint.
+ * 2. The log (path + ".log") is an append-only list of the insert
+ *    and extract operations made since that checkpoint. Every
+ *    record carries a sequence number (LSN) and a checksum.
+ *
+ * Log records are written and fdatasync()'d in groups of
+ * group_commit operations (group commit), so the cost of a sync is
+ * spread over the group. After a crash, at most the operations of
+ * the unsynced group are lost; call sync() to close a group early.
+ * On open, the log records after the heap file's checkpoint LSN
+ * are replayed in order, stopping at the first torn or corrupt
+ * record, which is then cut off.
+ *
+ * If writing or syncing a group fails, the group is cut off the
+ * log again (as a crash would have lost it), the operation that
+ * triggered the write is not applied, and every later insert,
+ * extractMin, sync and checkpoint throws std::runtime_error.
+ * Reopen the heap to carry on from what reached the disk.
+ *
+ * Checkpoint when the log gets long: it writes the heap to a
+ * temporary file, fsyncs it, renames it over the heap file and
+ * empties the log. A crash at any point leaves either the old or
+ * the new heap file, and the LSNs tell recovery which log records
+ * it already contains.
+ *
+ * Node<keytype, valuetype> must be trivially copyable, since it is
+ * stored byte for byte. The heap holds at most max_records
+ * elements (insert throws std::length_error beyond that); the
+ * address range for them is reserved up front but only touched
+ * pages use memory. I/O errors throw std::runtime_error. POSIX
+ * only, and one PersistentHeap per path at a time.
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef PERSISTENT_HEAP_CPP
+#define PERSISTENT_HEAP_CPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include "Heap.cpp"
+#include "HeapAlgorithms.cpp"
+
+
+// PersistentHeap is a binary Min-Ordered Heap kept in a file, with a write-ahead log
+template <typename keytype, typename valuetype>
+class PersistentHeap {
+    static_assert(std::is_trivially_copyable<Node<keytype, valuetype>>::value,
+                  "PersistentHeap stores Node records byte for byte");
+
+public:
+    PersistentHeap(const std::string &path, int max_records = 1 << 20, int group_commit = 64);
+    PersistentHeap(const PersistentHeap &) = delete;
+    PersistentHeap& operator=(const PersistentHeap &) = delete;
+
+    void insert(keytype k, valuetype v);            // Inserts key k and value v, logged
+    keytype peekKey();                              // Return min key without modifying the Heap
+    valuetype peekValue();                          // Return min value without modifying the Heap
+    keytype extractMin();                           // Removes the min element and returns its key, logged
+    int size();                                     // Return the number of elements in the Heap
+    void sync();                                    // Write and fdatasync every logged operation now
+    void checkpoint();                              // Replace the heap file with the current heap, empty the log
+    std::uint64_t lsn();                            // Sequence number of the last operation
+    ~PersistentHeap();                              // Syncs the log, does not checkpoint
+
+private:
+    enum LogOp {LOG_INSERT = 1, LOG_EXTRACT = 2};
+
+    // The heap file starts with one cache line of header, then the nodes.
+    struct FileHeader {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t record_size;                  // sizeof(Node), guards against opening with other types
+        std::uint64_t count;                        // Number of nodes that follow
+        std::uint64_t checkpoint_lsn;               // LSN of the last operation the nodes include
+        char padding[32];
+    };
+    static_assert(sizeof(FileHeader) == 64, "FileHeader must be one cache line");
+
+    // Copying a struct need not copy its padding, so checksums are taken
+    // over the exact bytes that are written and read, never over a copy.
+    struct LogRecord {
+        std::uint32_t checksum;                     // FNV-1a of the bytes after it
+        std::uint32_t op;                           // A LogOp
+        std::uint64_t lsn;
+        Node<keytype, valuetype> node;              // The inserted node, zero for LOG_EXTRACT
+    };
+
+    // Orders Nodes by key for the HeapAlgorithms.cpp sifts.
+    struct NodeKeyOrder {
+        bool operator()(const Node<keytype, valuetype> &a, const Node<keytype, valuetype> &b) const { return a.key < b.key; }
+    };
+
+    static const std::uint64_t kMagic = 0x5048454150763031ULL;     // "PHEAPv01"
+
+    void mapHeapFile();                             // Reserve the address range and map the heap file into it
+    void replayLog();                               // Open the log and apply its records past the checkpoint
+    void appendLog(LogOp op, const Node<keytype, valuetype> &node);
+    void writeGroup(int records);                   // Write and fdatasync the first records of log_buffer_
+    void checkNotFailed();                          // Throw if an earlier log write failed
+    static std::uint32_t checksum(const unsigned char* record_bytes);
+    static void writeAll(int fd, const void* data, std::size_t bytes);
+
+    void applyInsert(const Node<keytype, valuetype> &node);
+    void applyExtract();
+
+    std::string path_;
+    std::string log_path_;
+    char* region_;                                  // Reserved range: header, then max_records_ nodes
+    std::size_t region_bytes_;
+    Node<keytype, valuetype>* nodes_;
+    int size_;
+    int max_records_;
+    int log_fd_;
+    int group_commit_;
+    unsigned char* log_buffer_;                     // Bytes of the group_commit_ records of the current group
+    int pending_;                                   // Records in log_buffer_ not yet written
+    off_t log_bytes_;                               // Size of the log up to its last synced record
+    bool failed_;                                   // A log write failed, nothing more may be logged
+    std::uint64_t lsn_;
+    std::uint64_t checkpoint_lsn_;
+};
+
+
+template <typename keytype, typename valuetype>
+PersistentHeap<keytype, valuetype>::PersistentHeap(const std::string &path, int max_records, int group_commit) {
+    path_ = path;
+    log_path_ = path + ".log";
+    max_records_ = (max_records < 1) ? 1 : max_records;
+    group_commit_ = (group_commit < 1) ? 1 : group_commit;
+    region_ = nullptr;
+    log_fd_ = -1;
+    mapHeapFile();
+    log_buffer_ = new unsigned char[sizeof(LogRecord) * group_commit_];
+    pending_ = 0;
+    failed_ = false;
+    try {
+        replayLog();
+    }
+    catch (...) {
+        munmap(region_, region_bytes_);
+        delete[] log_buffer_;
+        if (log_fd_ >= 0) {
+            close(log_fd_);
+        }
+        throw;
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::insert(keytype k, valuetype v) {
+    if (size_ == max_records_) {
+        throw std::length_error("PersistentHeap is full");
+    }
+    Node<keytype, valuetype> node;
+    std::memset((void*)&node, 0, sizeof(node));
+    node.key = k;
+    node.value = v;
+    appendLog(LOG_INSERT, node);
+    applyInsert(node);
+}
+
+
+template <typename keytype, typename valuetype>
+keytype PersistentHeap<keytype, valuetype>::peekKey() {
+    if (size_ == 0) {
+        throw std::out_of_range("PersistentHeap::peekKey on an empty heap");
+    }
+    return nodes_[0].key;
+}
+
+
+template <typename keytype, typename valuetype>
+valuetype PersistentHeap<keytype, valuetype>::peekValue() {
+    if (size_ == 0) {
+        throw std::out_of_range("PersistentHeap::peekValue on an empty heap");
+    }
+    return nodes_[0].value;
+}
+
+
+template <typename keytype, typename valuetype>
+keytype PersistentHeap<keytype, valuetype>::extractMin() {
+    if (size_ == 0) {
+        throw std::out_of_range("PersistentHeap::extractMin on an empty heap");
+    }
+    keytype return_key = nodes_[0].key;
+    Node<keytype, valuetype> none;
+    std::memset((void*)&none, 0, sizeof(none));
+    appendLog(LOG_EXTRACT, none);
+    applyExtract();
+    return return_key;
+}
+
+
+template <typename keytype, typename valuetype>
+int PersistentHeap<keytype, valuetype>::size() {
+    return size_;
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::sync() {
+    checkNotFailed();
+    if (pending_ == 0) {
+        return;
+    }
+    writeGroup(pending_);
+    pending_ = 0;
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::checkpoint() {
+    sync();
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = kMagic;
+    header.version = 1;
+    header.record_size = sizeof(Node<keytype, valuetype>);
+    header.count = size_;
+    header.checkpoint_lsn = lsn_;
+
+    std::string temp_path = path_ + ".tmp";
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("PersistentHeap: cannot create " + temp_path);
+    }
+    try {
+        writeAll(fd, &header, sizeof(header));
+        writeAll(fd, nodes_, sizeof(Node<keytype, valuetype>) * size_);
+        if (fsync(fd) != 0) {
+            throw std::runtime_error("PersistentHeap: cannot sync " + temp_path);
+        }
+    }
+    catch (...) {
+        close(fd);
+        unlink(temp_path.c_str());
+        throw;
+    }
+    close(fd);
+
+    // The rename is the commit point. Sync the directory so it sticks.
+    if (rename(temp_path.c_str(), path_.c_str()) != 0) {
+        unlink(temp_path.c_str());
+        throw std::runtime_error("PersistentHeap: cannot replace " + path_);
+    }
+    std::string::size_type slash = path_.rfind('/');
+    std::string directory = (slash == std::string::npos) ? "." : path_.substr(0, slash + 1);
+    int directory_fd = open(directory.c_str(), O_RDONLY);
+    if (directory_fd >= 0) {
+        fsync(directory_fd);
+        close(directory_fd);
+    }
+    checkpoint_lsn_ = lsn_;
+
+    // The heap file now includes everything in the log. Should the process
+    // die before this truncate, recovery skips the records by their LSN.
+    if (ftruncate(log_fd_, 0) != 0 || fdatasync(log_fd_) != 0) {
+        throw std::runtime_error("PersistentHeap: cannot truncate " + log_path_);
+    }
+    log_bytes_ = 0;
+}
+
+
+template <typename keytype, typename valuetype>
+std::uint64_t PersistentHeap<keytype, valuetype>::lsn() {
+    return lsn_;
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::mapHeapFile() {
+    long page_size = sysconf(_SC_PAGESIZE);
+    int fd = open(path_.c_str(), O_RDONLY);
+    std::size_t file_bytes = 0;
+    if (fd >= 0) {
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            close(fd);
+            throw std::runtime_error("PersistentHeap: cannot stat " + path_);
+        }
+        file_bytes = (std::size_t)file_stat.st_size;
+        // checkpoint writes a header and whole records, nothing else. Any
+        // other size is rejected, which also keeps the mapping of the file
+        // inside the range reserved for max_records_ records.
+        if (file_bytes < sizeof(FileHeader) || (file_bytes - sizeof(FileHeader)) % sizeof(Node<keytype, valuetype>) != 0) {
+            close(fd);
+            throw std::runtime_error("PersistentHeap: " + path_ + " is not a heap file of this type");
+        }
+        std::size_t file_records = (file_bytes - sizeof(FileHeader)) / sizeof(Node<keytype, valuetype>);
+        if ((std::size_t)max_records_ < file_records) {
+            max_records_ = (int)file_records;
+        }
+    }
+    else if (errno != ENOENT) {
+        throw std::runtime_error("PersistentHeap: cannot open " + path_);
+    }
+
+    // Reserve the whole range as anonymous memory, then map the file over
+    // its front. Only whole pages of the file are mapped, since touching a
+    // mapped page past the end of the file would fault.
+    std::size_t wanted = sizeof(FileHeader) + sizeof(Node<keytype, valuetype>) * (std::size_t)max_records_;
+    region_bytes_ = (wanted + page_size - 1) / page_size * page_size;
+    void* region = mmap(nullptr, region_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("PersistentHeap: cannot reserve memory for " + path_);
+    }
+    region_ = (char*)region;
+    nodes_ = (Node<keytype, valuetype>*)(region_ + sizeof(FileHeader));
+    size_ = 0;
+    checkpoint_lsn_ = 0;
+
+    if (fd >= 0) {
+        std::size_t mapped_bytes = (file_bytes + page_size - 1) / page_size * page_size;
+        void* mapped = MAP_FAILED;
+        if (mapped_bytes <= region_bytes_) {
+            mapped = mmap(region_, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        }
+        close(fd);
+        FileHeader* header = (FileHeader*)region_;
+        if (mapped == MAP_FAILED
+            || file_bytes < sizeof(FileHeader)
+            || header->magic != kMagic
+            || header->record_size != sizeof(Node<keytype, valuetype>)
+            || file_bytes < sizeof(FileHeader) + header->count * sizeof(Node<keytype, valuetype>)) {
+            munmap(region_, region_bytes_);
+            throw std::runtime_error("PersistentHeap: " + path_ + " is not a heap file of this type");
+        }
+        size_ = (int)header->count;
+        checkpoint_lsn_ = header->checkpoint_lsn;
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::replayLog() {
+    log_fd_ = open(log_path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (log_fd_ < 0) {
+        throw std::runtime_error("PersistentHeap: cannot open " + log_path_);
+    }
+    lsn_ = checkpoint_lsn_;
+
+    // Records up to the checkpoint are already in the heap file. After
+    // that, each record must be intact and carry the next LSN.
+    off_t offset = 0;
+    unsigned char record_bytes[sizeof(LogRecord)];
+    LogRecord record;
+    while (pread(log_fd_, record_bytes, sizeof(record_bytes), offset) == (ssize_t)sizeof(record_bytes)) {
+        std::memcpy((void*)&record, record_bytes, sizeof(record));
+        if (record.checksum != checksum(record_bytes)) {
+            break;
+        }
+        if (record.lsn > checkpoint_lsn_) {
+            if (record.lsn != lsn_ + 1) {
+                break;
+            }
+            if (record.op == LOG_INSERT) {
+                if (size_ == max_records_) {
+                    throw std::length_error("PersistentHeap: the log does not fit in max_records");
+                }
+                applyInsert(record.node);
+            }
+            else if (record.op == LOG_EXTRACT && size_ > 0) {
+                applyExtract();
+            }
+            else {
+                break;
+            }
+            lsn_ = record.lsn;
+        }
+        offset += sizeof(record);
+    }
+
+    // Cut off a torn or corrupt tail, so new records follow valid ones.
+    if (ftruncate(log_fd_, offset) != 0) {
+        throw std::runtime_error("PersistentHeap: cannot truncate " + log_path_);
+    }
+    log_bytes_ = offset;
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::appendLog(LogOp op, const Node<keytype, valuetype> &node) {
+    checkNotFailed();
+    LogRecord record;
+    std::memset((void*)&record, 0, sizeof(record));
+    record.lsn = lsn_ + 1;
+    record.op = op;
+    record.node = node;
+
+    unsigned char* record_bytes = log_buffer_ + sizeof(LogRecord) * pending_;
+    std::memcpy(record_bytes, (const void*)&record, sizeof(record));
+    std::uint32_t record_checksum = checksum(record_bytes);
+    std::memcpy(record_bytes, &record_checksum, sizeof(record_checksum));
+
+    // The record only counts once its group is written, should that throw
+    // the caller does not apply the operation.
+    if (pending_ + 1 == group_commit_) {
+        writeGroup(pending_ + 1);
+        pending_ = 0;
+    }
+    else {
+        pending_++;
+    }
+    lsn_++;
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::writeGroup(int records) {
+    // One write and one fdatasync for the whole group.
+    try {
+        writeAll(log_fd_, log_buffer_, sizeof(LogRecord) * records);
+        if (fdatasync(log_fd_) != 0) {
+            throw std::runtime_error("PersistentHeap: cannot sync " + log_path_);
+        }
+    }
+    catch (...) {
+        // How much of the group reached the disk is unknown. Cut all of it
+        // off (best effort) and refuse to go on, so that no operation the
+        // caller saw fail is replayed later.
+        failed_ = true;
+        if (ftruncate(log_fd_, log_bytes_) == 0) {
+            fdatasync(log_fd_);
+        }
+        throw;
+    }
+    log_bytes_ += (off_t)(sizeof(LogRecord) * records);
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::checkNotFailed() {
+    if (failed_) {
+        throw std::runtime_error("PersistentHeap: a write to " + log_path_ + " failed, reopen the heap");
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+std::uint32_t PersistentHeap<keytype, valuetype>::checksum(const unsigned char* record_bytes) {
+    std::uint32_t hash = 2166136261u;
+    for (std::size_t i = sizeof(std::uint32_t); i < sizeof(LogRecord); i++) {
+        hash = (hash ^ record_bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::writeAll(int fd, const void* data, std::size_t bytes) {
+    const char* next = (const char*)data;
+    while (bytes > 0) {
+        ssize_t written = write(fd, next, bytes);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("PersistentHeap: write failed");
+        }
+        next += written;
+        bytes -= (std::size_t)written;
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::applyInsert(const Node<keytype, valuetype> &node) {
+    nodes_[size_] = node;
+    size_++;
+    PushHeap(nodes_, size_, NodeKeyOrder());
+}
+
+
+template <typename keytype, typename valuetype>
+void PersistentHeap<keytype, valuetype>::applyExtract() {
+    PopHeap(nodes_, size_, NodeKeyOrder());
+    size_--;
+}
+
+
+template <typename keytype, typename valuetype>
+PersistentHeap<keytype, valuetype>::~PersistentHeap() {
+    try {
+        sync();
+    }
+    catch (...) {
+        // Nothing can be reported from a destructor, the unsynced group is lost.
+    }
+    munmap(region_, region_bytes_);
+    delete[] log_buffer_;
+    close(log_fd_);
+}
+
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Implementation of a Radix Heap.
+ *
+ * This file contains one class:
+ * 1. RadixHeap
+ *
+ * RadixHeap is templated with two typenames, keytype and
+ * valuetype, and has the insert/peekKey/peekValue/extractMin
+ * surface of Heap:
+ *    RadixHeap<unsigned int, valuetype> that_name;
+ *
+ * keytype must be an unsigned integral type, and the Heap must
+ * be monotone: a key may never be smaller than lastKey(), the
+ * minimum most recently seen by peekKey, peekValue or extractMin.
+ * That holds for event simulation (nothing is scheduled in the
+ * past) and for Dijkstra's algorithm with non-negative edge
+ * weights, and is checked by insert, which throws
+ * std::invalid_argument on a key below lastKey().
+ *
+ * Elements are kept in buckets indexed by the highest bit in
+ * which their key differs from the last minimum (bucket 0 holds
+ * keys equal to it). No comparisons are made on insert. When
+ * bucket 0 runs dry, the lowest non-empty bucket supplies the new
+ * minimum and its elements are spread over lower buckets. Every
+ * element can only move down, at most once per bit of keytype,
+ * so operations are O(log C) amortized (C being the spread of
+ * keys), with a bucket index computed by a single instruction.
+ *
+ * Removing from an empty RadixHeap throws std::out_of_range.
+ * Requires C++20 (for std::bit_width).
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef RADIX_HEAP_CPP
+#define RADIX_HEAP_CPP
+
+#include <bit>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "CDA.cpp"
+#include "Heap.cpp"
+
+
+// RadixHeap is a monotone Min-Ordered Heap of unsigned integer keys
+template <typename keytype, typename valuetype>
+class RadixHeap {
+    static_assert(std::is_integral<keytype>::value && std::is_unsigned<keytype>::value,
+                  "RadixHeap keys must be an unsigned integral type");
+
+public:
+    RadixHeap();                                    // Default Constructor for empty RadixHeap
+
+    void insert(keytype k, valuetype v);            // Inserts key k and value v, k must not be below lastKey()
+    keytype peekKey();                              // Return min key without removing it
+    valuetype peekValue();                          // Return min value without removing it
+    keytype extractMin();                           // Removes the min element and returns its key
+    int size();                                     // Return the number of elements
+    keytype lastKey();                              // The last minimum, the smallest key insert accepts
+
+private:
+    static const int kBuckets = std::numeric_limits<keytype>::digits + 1;
+
+    int bucketIndex(keytype k);                     // Bucket of k relative to last_
+    void refill();                                  // Make bucket 0 non-empty, size must be > 0
+
+    CDA<Node<keytype, valuetype>, UncheckedIndex> buckets_[kBuckets];
+    keytype last_;                                  // The last minimum, every key is >= last_
+    int size_;
+};
+
+
+template <typename keytype, typename valuetype>
+RadixHeap<keytype, valuetype>::RadixHeap() {
+    last_ = 0;
+    size_ = 0;
+}
+
+
+template <typename keytype, typename valuetype>
+void RadixHeap<keytype, valuetype>::insert(keytype k, valuetype v) {
+    if (k < last_) {
+        throw std::invalid_argument("RadixHeap::insert key is below the last minimum");
+    }
+    buckets_[bucketIndex(k)].AddEnd(Node<keytype, valuetype>(k, std::move(v)));
+    size_++;
+}
+
+
+template <typename keytype, typename valuetype>
+keytype RadixHeap<keytype, valuetype>::peekKey() {
+    if (size_ == 0) {
+        throw std::out_of_range("RadixHeap::peekKey on an empty heap");
+    }
+    refill();
+    return last_;
+}
+
+
+template <typename keytype, typename valuetype>
+valuetype RadixHeap<keytype, valuetype>::peekValue() {
+    if (size_ == 0) {
+        throw std::out_of_range("RadixHeap::peekValue on an empty heap");
+    }
+    refill();
+    return buckets_[0][buckets_[0].Length() - 1].value;
+}
+
+
+template <typename keytype, typename valuetype>
+keytype RadixHeap<keytype, valuetype>::extractMin() {
+    if (size_ == 0) {
+        throw std::out_of_range("RadixHeap::extractMin on an empty heap");
+    }
+    refill();
+    buckets_[0].DelEnd();
+    size_--;
+    return last_;
+}
+
+
+template <typename keytype, typename valuetype>
+int RadixHeap<keytype, valuetype>::size() {
+    return size_;
+}
+
+
+template <typename keytype, typename valuetype>
+keytype RadixHeap<keytype, valuetype>::lastKey() {
+    return last_;
+}
+
+
+template <typename keytype, typename valuetype>
+int RadixHeap<keytype, valuetype>::bucketIndex(keytype k) {
+    return std::bit_width((keytype)(k ^ last_));
+}
+
+
+template <typename keytype, typename valuetype>
+void RadixHeap<keytype, valuetype>::refill() {
+    if (buckets_[0].Length() > 0) {
+        return;
+    }
+    int i = 1;
+    while (buckets_[i].Length() == 0) {
+        i++;
+    }
+
+    // The smallest key of the bucket becomes the new minimum. All of the
+    // bucket's keys agree with it above bit i - 1, so relative to it they
+    // fall into strictly lower buckets.
+    CDA<Node<keytype, valuetype>, UncheckedIndex> &bucket = buckets_[i];
+    keytype new_last = bucket[0].key;
+    for (int j = 1; j < bucket.Length(); j++) {
+        if (bucket[j].key < new_last) {
+            new_last = bucket[j].key;
+        }
+    }
+    last_ = new_last;
+    for (int j = 0; j < bucket.Length(); j++) {
+        buckets_[bucketIndex(bucket[j].key)].AddEnd(std::move(bucket[j]));
+    }
+    bucket.DelEnd(bucket.Length());
+}
+
+
+#endif
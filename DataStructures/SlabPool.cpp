@@ -0,0 +1,346 @@
+/*
+ * Implementation of a Slab Pool allocator.
+ *
+ * This file contains two classes:
+ * 1. SlabPoolStats
+ * 2. SlabPool
+ *
+ * SlabPool is templated with one typename, T, and hands out
+ * storage for one T at a time:
+ *    SlabPool<BNode<keytype, valuetype>> pool;
+ *    BNode<keytype, valuetype>* bnode = pool.allocate();
+ *    pool.release(bnode);
+ *
+ * Objects are carved out of slabs, large blocks that are aligned
+ * to a cache line and a whole number of cache lines long. The
+ * first slab holds kFirstSlabObjects objects and every new slab
+ * doubles that, up to kMaxSlabObjects, so a pool of n objects
+ * makes O(log n) calls to operator new. Released objects go on a
+ * free list (threaded through their own storage) and are handed
+ * out again before a slab is touched, so a steady stream of
+ * allocate/release pairs never reaches the system allocator.
+ *
+ * adopt() takes over every slab of another pool in O(#slabs),
+ * which lets a node based structure absorb another one (e.g.
+ * BHeap::merge) without copying its nodes. Both pools may have a
+ * partly used slab, but only one can be bumped from at a time, so
+ * the unused end of the other is kept as a spare range (its end
+ * and the next range are stored in its first two slots) and bumped
+ * from once the current slab runs out, rather than pushed slot by
+ * slot onto the free list.
+ * releaseAll() frees every slab in O(#slabs) without destroying
+ * anything, for when T is trivially destructible or the live
+ * objects have already been destroyed.
+ *
+ * A SlabPool is not thread safe. Stats() counts allocations,
+ * reuses and slabs (see SlabPoolStats).
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef SLAB_POOL_CPP
+#define SLAB_POOL_CPP
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+
+// SlabPoolStats is a plain snapshot of the counters of one SlabPool.
+struct SlabPoolStats {
+    long long allocations;                          // Calls to allocate().
+    long long reuses;                               // allocate() calls served from the free list.
+    long long releases;                             // Calls to release().
+    long long slabs;                                // Slabs held right now.
+    long long bytes_reserved;                       // Bytes held in slabs right now.
+    long long live_objects;                         // Objects allocated and not yet released.
+};
+
+
+// SlabPool allocates objects of type T from cache line aligned slabs, reusing released ones
+template <typename T>
+class SlabPool {
+public:
+    SlabPool();
+    SlabPool(const SlabPool &) = delete;
+    SlabPool& operator=(const SlabPool &) = delete;
+
+    template <typename... Args>
+    T* allocate(Args&&... args);                    // Construct a T in pool storage
+    void release(T* object);                        // Destroy object and keep its storage for reuse
+    void adopt(SlabPool &other);                    // Take over every slab of other, leaving it empty
+    void reserve(long long count);                  // Make room for count more objects with at most one new slab
+    void releaseAll();                              // Free every slab without destroying the objects in them
+    SlabPoolStats Stats();                          // Snapshot of this pool's counters
+    ~SlabPool();                                    // Calls releaseAll, live objects are not destroyed
+
+private:
+    static const std::size_t kCacheLine = 64;
+    static const long long kFirstSlabObjects = 8;
+    static const long long kMaxSlabObjects = 65536;
+
+    // Storage for one object, or a link in the free list once it is released.
+    union Slot {
+        Slot* next_free;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    // Every slab starts with this header, followed by its slots.
+    struct SlabHeader {
+        SlabHeader* next;                           // The next slab in the pool's list
+        std::size_t bytes;                          // Size of the whole slab
+    };
+
+    static std::size_t alignment();                 // Alignment of every slab
+    static std::size_t firstSlotOffset();           // Offset of the first slot from the start of a slab
+    void addSlab(long long count);                  // Allocate a slab of count slots and make it current
+    void pushFree(Slot* slot);                      // Put slot at the front of the free list
+    void pushSpare(Slot* begin, Slot* end);         // Keep the unused slots begin..end-1 to bump from later
+    void popSpare();                                // Make the first spare range the current one
+
+    SlabHeader* slabs_;                             // Every slab of the pool, newest first
+    Slot* free_list_;                               // Released slots, most recent first
+    Slot* free_tail_;                               // Last slot of free_list_, so adopt can append in O(1)
+    Slot* bump_;                                    // Next never used slot of the current slab
+    Slot* bump_end_;                                // End of the current slab
+    Slot* spare_;                                   // First unused range waiting to be bumped from
+    Slot* spare_tail_;                              // First slot of the last spare range, so adopt can append in O(1)
+    long long next_slab_objects_;                   // Slots in the next slab to allocate
+    SlabPoolStats stats_;
+};
+
+
+template <typename T>
+SlabPool<T>::SlabPool() {
+    slabs_ = nullptr;
+    free_list_ = nullptr;
+    free_tail_ = nullptr;
+    bump_ = nullptr;
+    bump_end_ = nullptr;
+    spare_ = nullptr;
+    spare_tail_ = nullptr;
+    next_slab_objects_ = kFirstSlabObjects;
+    stats_ = SlabPoolStats();
+}
+
+
+template <typename T>
+template <typename... Args>
+T* SlabPool<T>::allocate(Args&&... args) {
+    Slot* slot;
+    if (free_list_ != nullptr) {
+        slot = free_list_;
+        free_list_ = free_list_->next_free;
+        if (free_list_ == nullptr) {
+            free_tail_ = nullptr;
+        }
+        stats_.reuses++;
+    }
+    else {
+        if (bump_ == bump_end_ && spare_ != nullptr) {
+            popSpare();
+        }
+        else if (bump_ == bump_end_) {
+            addSlab(next_slab_objects_);
+            if (next_slab_objects_ < kMaxSlabObjects) {
+                next_slab_objects_ *= 2;
+            }
+        }
+        slot = bump_;
+        bump_++;
+    }
+    T* object = new (slot->storage) T(std::forward<Args>(args)...);
+    stats_.allocations++;
+    stats_.live_objects++;
+    return object;
+}
+
+
+template <typename T>
+void SlabPool<T>::release(T* object) {
+    object->~T();
+    pushFree(reinterpret_cast<Slot*>(object));
+    stats_.releases++;
+    stats_.live_objects--;
+}
+
+
+template <typename T>
+void SlabPool<T>::adopt(SlabPool<T> &other) {
+    if (&other == this || other.slabs_ == nullptr) {
+        return;
+    }
+
+    // Splice the other pool's slab list in front of ours.
+    SlabHeader* last = other.slabs_;
+    while (last->next != nullptr) {
+        last = last->next;
+    }
+    last->next = slabs_;
+    slabs_ = other.slabs_;
+
+    if (other.free_list_ != nullptr) {
+        other.free_tail_->next_free = free_list_;
+        if (free_list_ == nullptr) {
+            free_tail_ = other.free_tail_;
+        }
+        free_list_ = other.free_list_;
+    }
+
+    if (other.spare_ != nullptr) {
+        other.spare_tail_[0].next_free = spare_;
+        if (spare_ == nullptr) {
+            spare_tail_ = other.spare_tail_;
+        }
+        spare_ = other.spare_;
+    }
+
+    // Only one slab can be bumped from. Keep whichever has more room left,
+    // and keep the unused end of the other as a spare range.
+    if (other.bump_end_ - other.bump_ > bump_end_ - bump_) {
+        pushSpare(bump_, bump_end_);
+        bump_ = other.bump_;
+        bump_end_ = other.bump_end_;
+    }
+    else {
+        pushSpare(other.bump_, other.bump_end_);
+    }
+    if (other.next_slab_objects_ > next_slab_objects_) {
+        next_slab_objects_ = other.next_slab_objects_;
+    }
+
+    stats_.slabs += other.stats_.slabs;
+    stats_.bytes_reserved += other.stats_.bytes_reserved;
+    stats_.live_objects += other.stats_.live_objects;
+
+    other.slabs_ = nullptr;
+    other.free_list_ = nullptr;
+    other.free_tail_ = nullptr;
+    other.bump_ = nullptr;
+    other.bump_end_ = nullptr;
+    other.spare_ = nullptr;
+    other.spare_tail_ = nullptr;
+    other.next_slab_objects_ = kFirstSlabObjects;
+    other.stats_.slabs = 0;
+    other.stats_.bytes_reserved = 0;
+    other.stats_.live_objects = 0;
+}
+
+
+template <typename T>
+void SlabPool<T>::reserve(long long count) {
+    if (bump_end_ - bump_ >= count) {
+        return;
+    }
+    addSlab(count);
+}
+
+
+template <typename T>
+void SlabPool<T>::releaseAll() {
+    while (slabs_ != nullptr) {
+        SlabHeader* next = slabs_->next;
+        ::operator delete[](reinterpret_cast<void*>(slabs_), std::align_val_t(alignment()));
+        slabs_ = next;
+    }
+    free_list_ = nullptr;
+    free_tail_ = nullptr;
+    bump_ = nullptr;
+    bump_end_ = nullptr;
+    spare_ = nullptr;
+    spare_tail_ = nullptr;
+    next_slab_objects_ = kFirstSlabObjects;
+    stats_.slabs = 0;
+    stats_.bytes_reserved = 0;
+    stats_.live_objects = 0;
+}
+
+
+template <typename T>
+SlabPoolStats SlabPool<T>::Stats() {
+    return stats_;
+}
+
+
+template <typename T>
+std::size_t SlabPool<T>::alignment() {
+    return alignof(Slot) > kCacheLine ? alignof(Slot) : kCacheLine;
+}
+
+
+template <typename T>
+std::size_t SlabPool<T>::firstSlotOffset() {
+    // The header gets a cache line (or more) to itself, so the slots start aligned.
+    return (sizeof(SlabHeader) + alignment() - 1) / alignment() * alignment();
+}
+
+
+template <typename T>
+void SlabPool<T>::addSlab(long long count) {
+    std::size_t bytes = firstSlotOffset() + sizeof(Slot) * (std::size_t)count;
+    bytes = (bytes + kCacheLine - 1) / kCacheLine * kCacheLine;
+    char* block = static_cast<char*>(::operator new[](bytes, std::align_val_t(alignment())));
+
+    SlabHeader* header = reinterpret_cast<SlabHeader*>(block);
+    header->next = slabs_;
+    header->bytes = bytes;
+    slabs_ = header;
+
+    // Whatever was left of the previous slab is bumped from later.
+    pushSpare(bump_, bump_end_);
+    bump_ = reinterpret_cast<Slot*>(block + firstSlotOffset());
+    bump_end_ = bump_ + count;
+
+    stats_.slabs++;
+    stats_.bytes_reserved += (long long)bytes;
+}
+
+
+template <typename T>
+void SlabPool<T>::pushFree(Slot* slot) {
+    slot->next_free = free_list_;
+    if (free_list_ == nullptr) {
+        free_tail_ = slot;
+    }
+    free_list_ = slot;
+}
+
+
+template <typename T>
+void SlabPool<T>::pushSpare(Slot* begin, Slot* end) {
+    // A range needs two slots to record itself, a single slot is simply freed.
+    if (end - begin < 2) {
+        if (begin != end) {
+            pushFree(begin);
+        }
+        return;
+    }
+    begin[0].next_free = spare_;
+    begin[1].next_free = end;
+    if (spare_ == nullptr) {
+        spare_tail_ = begin;
+    }
+    spare_ = begin;
+}
+
+
+template <typename T>
+void SlabPool<T>::popSpare() {
+    bump_ = spare_;
+    bump_end_ = spare_[1].next_free;
+    spare_ = spare_[0].next_free;
+    if (spare_ == nullptr) {
+        spare_tail_ = nullptr;
+    }
+}
+
+
+template <typename T>
+SlabPool<T>::~SlabPool() {
+    releaseAll();
+}
+
+
+#endif
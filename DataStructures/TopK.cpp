@@ -0,0 +1,150 @@
+/*
+ * Implementation of a bounded Top-K operator.
+ *
+ * This file contains one class:
+ * 1. TopK
+ *
+ * TopK<keytype, valuetype> watches a stream of (key, value) pairs
+ * and keeps only the K with the largest keys seen so far, so its
+ * memory stays fixed no matter how long the stream runs:
+ *
+ *    TopK<int, std::string> top(10);
+ *    for (...) {
+ *        top.offer(score, name);
+ *    }
+ *    CDA<Node<int, std::string>> best;
+ *    top.results(best);                  // Largest key first.
+ *
+ * The K survivors live in a min-ordered Heap, so the worst of
+ * them is at the root. Once the Heap is full, a new pair is
+ * first compared against a cached copy of that worst key and
+ * rejected without touching the Heap, which is what happens to
+ * almost every pair of a long stream. A pair that does beat it
+ * takes the root's place with a single sift (Heap::replaceMin).
+ *
+ * Per-thread instances can be combined with merge(), which feeds
+ * the other instance's survivors through offer(), best first.
+ * TopK does no locking of its own.
+ *
+ *
+ * @author      Stephen Gregory
+ * @date        04/21/2020
+ */
+
+#ifndef TOPK_CPP
+#define TOPK_CPP
+
+#include <stdexcept>
+#include <utility>
+#include "CDA.cpp"
+#include "Heap.cpp"
+
+
+// TopK keeps the K pairs with the largest keys of a stream
+template <typename keytype, typename valuetype>
+class TopK {
+public:
+    TopK(int k);                                    // Keep at most k pairs, k must be positive
+
+    bool offer(keytype key, valuetype value);       // Consider one pair, true if it was kept
+    void merge(const TopK &other);                  // Offer every pair kept by other
+    void results(CDA<Node<keytype, valuetype>> &out);
+                                                    // Append the kept pairs to out, largest key first
+    keytype threshold();                            // The smallest kept key, which a new key must beat once full
+    int size();                                     // Number of pairs kept
+    int capacity();                                 // The K of this TopK
+    bool full();                                    // True once K pairs are kept
+    void clear();                                   // Forget every kept pair
+
+private:
+    int capacity_;
+    Heap<keytype, valuetype> heap_;                 // The kept pairs, worst at the root
+    keytype threshold_;                             // Copy of heap_.peekKey(), valid while full
+};
+
+
+template <typename keytype, typename valuetype>
+TopK<keytype, valuetype>::TopK(int k) {
+    if (k < 1) {
+        throw std::invalid_argument("TopK needs room for at least one pair");
+    }
+    capacity_ = k;
+}
+
+
+template <typename keytype, typename valuetype>
+bool TopK<keytype, valuetype>::offer(keytype key, valuetype value) {
+    if (heap_.size() < capacity_) {
+        heap_.insert(std::move(key), std::move(value));
+        if (heap_.size() == capacity_) {
+            threshold_ = heap_.peekKey();
+        }
+        return true;
+    }
+    // Fast reject: most pairs of a long stream lose to the worst survivor.
+    if (!(key > threshold_)) {
+        return false;
+    }
+    heap_.replaceMin(std::move(key), std::move(value));
+    threshold_ = heap_.peekKey();
+    return true;
+}
+
+
+template <typename keytype, typename valuetype>
+void TopK<keytype, valuetype>::merge(const TopK &other) {
+    // Drain a copy, then offer its pairs best first so that, once this
+    // TopK is full, the rest of them are turned away by the fast reject.
+    Heap<keytype, valuetype> drained = other.heap_;
+    CDA<Node<keytype, valuetype>> pairs;
+    drained.extractMinBatch(drained.size(), pairs);
+    for (int i = pairs.Length() - 1; i >= 0; i--) {
+        if (!offer(std::move(pairs[i].key), std::move(pairs[i].value))) {
+            break;
+        }
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+void TopK<keytype, valuetype>::results(CDA<Node<keytype, valuetype>> &out) {
+    Heap<keytype, valuetype> drained = heap_;
+    CDA<Node<keytype, valuetype>> pairs;
+    drained.extractMinBatch(drained.size(), pairs);
+    for (int i = pairs.Length() - 1; i >= 0; i--) {
+        out.AddEnd(std::move(pairs[i]));
+    }
+}
+
+
+template <typename keytype, typename valuetype>
+keytype TopK<keytype, valuetype>::threshold() {
+    return heap_.peekKey();
+}
+
+
+template <typename keytype, typename valuetype>
+int TopK<keytype, valuetype>::size() {
+    return heap_.size();
+}
+
+
+template <typename keytype, typename valuetype>
+int TopK<keytype, valuetype>::capacity() {
+    return capacity_;
+}
+
+
+template <typename keytype, typename valuetype>
+bool TopK<keytype, valuetype>::full() {
+    return heap_.size() == capacity_;
+}
+
+
+template <typename keytype, typename valuetype>
+void TopK<keytype, valuetype>::clear() {
+    heap_ = Heap<keytype, valuetype>();
+}
+
+
+#endif